@@ -0,0 +1,60 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef BENCH_STATS_H
+#define BENCH_STATS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Order statistics of nanosecond samples
+struct Summary {
+	double min;
+	double mean;
+	double p50;
+	double p90;
+	double p99;
+	double max;
+};
+
+// Sorts the samples, values are scaled by unit (1000 gives microseconds)
+static inline Summary summarize(std::vector<int64_t> &samples, double unit)
+{
+	Summary s = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+	if (samples.empty())
+		return s;
+
+	std::sort(samples.begin(), samples.end());
+
+	auto percentile = [&](double p) {
+		return (double)samples[(size_t)(p * (double)(samples.size() - 1))] / unit;
+	};
+
+	for (int64_t sample : samples)
+		s.mean += (double)sample;
+	s.mean /= (double)samples.size() * unit;
+	s.min = (double)samples.front() / unit;
+	s.p50 = percentile(0.5);
+	s.p90 = percentile(0.9);
+	s.p99 = percentile(0.99);
+	s.max = (double)samples.back() / unit;
+	return s;
+}
+
+#endif // !BENCH_STATS_H
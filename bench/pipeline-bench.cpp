@@ -0,0 +1,443 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+// Runs the analysis of the plugin's match job headless on synthetic frames, the same match
+// pipeline on a thread pool along with the score history and optionally the debug view. It
+// reports the latency of each stage and the heap allocations per frame once the buffers have
+// warmed up. The frames are textured noise with the templates cut out of them, so every
+// template is found, and alternate between two brightnesses so every frame is matched.
+// Exits with 1 if any frame allocates after the warm up, or if a template scores at the
+// default threshold in unrelated noise.
+//
+// Usage: pipeline-bench [iterations] [--no-opencl] [--debug-view]
+// The debug view needs a display.
+
+#include "DebugView.h"
+#include "MatchPipeline.h"
+#include "NccKernel.h"
+#include "ScoreHistory.h"
+#include "TemplateMatcher.h"
+#include "ThreadPool.h"
+#include "bench-stats.h"
+
+#include <opencv2/core/ocl.hpp>
+#include <util/platform.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+
+// Warm up iterations aren't measured, the first matches compute the template spectra and
+// start tracking, which shrinks the searched region
+#define WARMUP_ITERATIONS 5
+// Match threshold the plugin defaults to
+#define DEFAULT_THRESHOLD 0.8
+// Templates matched on every frame, like a filter with several slots in use
+#define TEMPLATES 3
+// Frames of scores kept, as in the plugin
+#define SCORE_HISTORY_SIZE 1800
+
+// Heap allocations through operator new and the OpenCV matrix allocator on the threads that
+// run the match job, the debug view draws on its own thread which isn't counted. UMat buffers
+// on an OpenCL device aren't seen, run with --no-opencl to count those too.
+static std::atomic<uint64_t> allocations(0);
+static thread_local bool counted = false;
+
+void *operator new(size_t size)
+{
+	if (counted)
+		allocations++;
+	void *p = malloc(size == 0 ? 1 : size);
+	if (p == nullptr)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	free(p);
+}
+
+class CountingAllocator : public cv::MatAllocator {
+public:
+	cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step,
+			       cv::AccessFlag flags, cv::UMatUsageFlags usage) const override
+	{
+		if (data == nullptr && counted)
+			allocations++;
+		return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags,
+							    usage);
+	}
+
+	bool allocate(cv::UMatData *data, cv::AccessFlag flags,
+		      cv::UMatUsageFlags usage) const override
+	{
+		return cv::Mat::getStdAllocator()->allocate(data, flags, usage);
+	}
+
+	void deallocate(cv::UMatData *data) const override
+	{
+		cv::Mat::getStdAllocator()->deallocate(data);
+	}
+};
+
+struct Format {
+	video_format format;
+	const char *name;
+};
+
+struct Resolution {
+	int width;
+	int height;
+	const char *name;
+};
+
+struct Scenario {
+	// Region of interest as a fraction of the frame, 1 searches the whole frame
+	double roi_scale;
+	int template_size;
+	int pyramid_levels;
+	// Elliptical mask like an icon cut out of a transparent image
+	bool masked;
+	// Template searched resized from 1 / scale_range to scale_range
+	double scale_range;
+};
+
+struct Stages {
+	std::vector<int64_t> total;
+	uint64_t allocations;
+};
+
+// Blurred noise, so the downscaled pyramid levels still have structure to match
+static cv::Mat make_pattern(int width, int height)
+{
+	cv::Mat noise(height, width, CV_8UC1);
+	cv::randu(noise, cv::Scalar(0), cv::Scalar(256));
+	cv::GaussianBlur(noise, noise, cv::Size(0, 0), 3.0);
+	cv::normalize(noise, noise, 0, 255, cv::NORM_MINMAX);
+	return noise;
+}
+
+static cv::Mat plane(obs_source_frame *frame, int plane, int width, int height, int type)
+{
+	return cv::Mat(height, width, type, frame->data[plane], frame->linesize[plane]);
+}
+
+// Frame of the format with the pattern as its luma
+static obs_source_frame *make_frame(video_format format, const cv::Mat &pattern)
+{
+	int width = pattern.cols;
+	int height = pattern.rows;
+	obs_source_frame *frame = obs_source_frame_create(format, width, height);
+
+	switch (format) {
+	case VIDEO_FORMAT_NV12:
+		pattern.copyTo(plane(frame, 0, width, height, CV_8UC1));
+		plane(frame, 1, width / 2, height / 2, CV_8UC2).setTo(cv::Scalar(128, 128));
+		break;
+	case VIDEO_FORMAT_I420:
+		pattern.copyTo(plane(frame, 0, width, height, CV_8UC1));
+		plane(frame, 1, width / 2, height / 2, CV_8UC1).setTo(cv::Scalar(128));
+		plane(frame, 2, width / 2, height / 2, CV_8UC1).setTo(cv::Scalar(128));
+		break;
+	case VIDEO_FORMAT_YUY2: {
+		// Y0 U Y1 V, luma in the even bytes
+		cv::Mat chroma(height, width, CV_8UC1, cv::Scalar(128));
+		cv::Mat packed = plane(frame, 0, width, height, CV_8UC2);
+		cv::merge(std::vector<cv::Mat>{pattern, chroma}, packed);
+		break;
+	}
+	case VIDEO_FORMAT_BGRA: {
+		cv::Mat alpha(height, width, CV_8UC1, cv::Scalar(255));
+		cv::Mat packed = plane(frame, 0, width, height, CV_8UC4);
+		cv::merge(std::vector<cv::Mat>{pattern, pattern, pattern, alpha}, packed);
+		break;
+	}
+	default:
+		break;
+	}
+	return frame;
+}
+
+// Counts the allocations of the workers of the pool and the calling thread. Every worker
+// takes one of the jobs, none of them finishes before all have started.
+static void count_allocations(ThreadPool &pool)
+{
+	counted = true;
+
+	std::atomic<size_t> started(0);
+	std::atomic<size_t> finished(0);
+	for (size_t i = 0; i < pool.Size(); i++) {
+		pool.Submit([&] {
+			counted = true;
+			started++;
+			while (started < pool.Size())
+				std::this_thread::yield();
+			finished++;
+		});
+	}
+	while (finished < pool.Size())
+		std::this_thread::yield();
+}
+
+// Milliseconds
+static double stage_p50(const PipelineStats &stats, PipelineStats::Stage stage)
+{
+	return stats.Read(stage).p50 / 1000.0;
+}
+
+// Returns false if a frame allocated after the warm up
+static bool run(const Format &format, const Resolution &resolution, const Scenario &scenario,
+		int iterations, ThreadPool &pool, DebugView *view)
+{
+	cv::Mat pattern = make_pattern(resolution.width, resolution.height);
+	// Brighter by a gray level, enough for the change detection to let every frame through
+	obs_source_frame *frames[2] = {make_frame(format.format, pattern),
+				       make_frame(format.format, pattern + cv::Scalar(1))};
+
+	cv::Size roi_size((int)(resolution.width * scenario.roi_scale),
+			  (int)(resolution.height * scenario.roi_scale));
+	cv::Rect roi(cv::Point((resolution.width - roi_size.width) / 2,
+			       (resolution.height - roi_size.height) / 2),
+		     roi_size);
+
+	// First template from the middle of the region, at an odd offset so no level is aligned,
+	// the others towards its corners
+	cv::Size size(scenario.template_size, scenario.template_size);
+	cv::Point cuts[TEMPLATES] = {
+		roi.tl() + cv::Point(roi.width / 2 + 3, roi.height / 2 + 5),
+		roi.tl() + cv::Point((roi.width - size.width) / 5, (roi.height - size.height) / 5),
+		roi.tl() + cv::Point((roi.width - size.width) * 4 / 5,
+				     (roi.height - size.height) * 4 / 5),
+	};
+	cv::Mat mask;
+	if (scenario.masked) {
+		mask = cv::Mat::zeros(size, CV_8UC1);
+		cv::ellipse(mask, cv::Point(size.width / 2, size.height / 2),
+			    cv::Size(size.width / 2, size.height / 3), 0, 0, 360, cv::Scalar(255),
+			    cv::FILLED);
+	}
+	auto templates = std::make_shared<TemplateList>();
+	for (size_t i = 0; i < TEMPLATES; i++) {
+		templates->push_back(std::make_shared<TemplateMatcher>(
+			i, "synthetic", pattern(cv::Rect(cuts[i], size)).clone(), mask,
+			DEFAULT_THRESHOLD, scenario.pyramid_levels, cv::TM_CCOEFF_NORMED,
+			1.0 / scenario.scale_range, scenario.scale_range));
+	}
+	std::shared_ptr<const TemplateList> list = templates;
+
+	// Same settings as a filter matching every frame
+	MatchPipeline::Settings settings = {};
+	settings.roi = scenario.roi_scale < 1.0 ? roi : cv::Rect();
+	settings.skip_unchanged = true;
+	settings.change_threshold = 0.5;
+	settings.score_maps = view != nullptr;
+
+	PipelineStats stats;
+	MatchPipeline pipeline(pool, stats);
+	ScoreHistory history(SCORE_HISTORY_SIZE, TEMPLATES);
+	ScoreHistory::Sample samples[TEMPLATES];
+	std::vector<DebugMatch> debug_matches;
+	debug_matches.reserve(TEMPLATES);
+
+	Stages stages = {};
+	stages.total.reserve(iterations);
+	int found = 0;
+	for (int i = 0; i < WARMUP_ITERATIONS + iterations; i++) {
+		const obs_source_frame *frame = frames[i % 2];
+		uint64_t allocated = allocations;
+		uint64_t start = os_gettime_ns();
+
+		if (!pipeline.Analyze(frame, FrameHandoff::ALL_ROWS, list, settings)) {
+			printf("%-5s %-6s no ingest for the format\n", format.name,
+			       resolution.name);
+			break;
+		}
+		const std::vector<MatchResult> &matches = pipeline.Matches();
+		cv::Rect region = pipeline.Region();
+
+		// What the plugin does with the results besides beeping
+		bool show_debug = view != nullptr && view->Wanted(start);
+		debug_matches.clear();
+		for (size_t t = 0; t < TEMPLATES; t++) {
+			const TemplateMatcher &matcher = *(*list)[t];
+			cv::Point location = matches[t].location + region.tl();
+			samples[t] = {(float)matches[t].score, location.x, location.y,
+				      matches[t].unfinished};
+			if (show_debug)
+				debug_matches.push_back(
+					{cv::Rect(matches[t].location, matcher.Size()),
+					 matches[t].score, matches[t].detected, false,
+					 matcher.ScoreMap(), matcher.ScoreMapArea()});
+		}
+		history.Add((uint64_t)i, samples);
+		if (show_debug) {
+			cv::Mat gray = pipeline.Gray().getMat(cv::ACCESS_READ);
+			view->Present(gray, debug_matches, os_gettime_ns() - start,
+				      os_gettime_ns());
+		}
+
+		uint64_t end = os_gettime_ns();
+		if (i < WARMUP_ITERATIONS)
+			continue;
+
+		stages.allocations += allocations - allocated;
+		stages.total.push_back((int64_t)(end - start));
+		if (matches[0].detected && matches[0].location + region.tl() == cuts[0])
+			found++;
+	}
+
+	obs_source_frame_destroy(frames[0]);
+	obs_source_frame_destroy(frames[1]);
+	if (stages.total.empty())
+		return true;
+
+	Summary total = summarize(stages.total, 1e6);
+	double fps = 1000.0 / total.mean;
+	double mpix = fps * roi.area() / 1e6;
+
+	double allocs = (double)stages.allocations / iterations;
+
+	printf("%-5s %-6s %5dx%-5d %4d %2d %c %2d  %6.2f %6.2f %6.2f %6.2f  %6.2f %6.2f "
+	       "%7.1f %8.1f %6.1f  %d/%d\n",
+	       format.name, resolution.name, roi.width, roi.height, scenario.template_size,
+	       (*list)[0]->PyramidLevels(), scenario.masked ? 'm' : '-', (*list)[0]->Scales(),
+	       stage_p50(stats, PipelineStats::STAGE_INGEST),
+	       stage_p50(stats, PipelineStats::STAGE_CHANGE),
+	       stage_p50(stats, PipelineStats::STAGE_PYRAMID),
+	       stage_p50(stats, PipelineStats::STAGE_MATCH), total.p50, total.p99, fps, mpix,
+	       allocs, found, iterations);
+	return stages.allocations == 0;
+}
+
+// Best score of a template in unrelated noise, a method scoring it at the default threshold
+// would beep on any busy scene
+static bool check_noise_scores()
+{
+	cv::Mat frame(360, 640, CV_8UC1);
+	cv::Mat templ(32, 32, CV_8UC1);
+	cv::randu(frame, cv::Scalar(0), cv::Scalar(256));
+	cv::randu(templ, cv::Scalar(0), cv::Scalar(256));
+	std::vector<cv::Mat> pyramid = {frame};
+
+	const int methods[] = {cv::TM_CCOEFF_NORMED, cv::TM_SQDIFF_NORMED};
+	const char *names[] = {"CCOEFF_NORMED", "SQDIFF_NORMED"};
+	bool passed = true;
+	for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+		TemplateMatcher matcher(0, "noise", templ, cv::Mat(), DEFAULT_THRESHOLD, 0,
+					methods[i]);
+		MatchResult match = matcher.Match(pyramid, cv::Point(0, 0));
+		bool below = match.score < DEFAULT_THRESHOLD;
+		printf("noise score %-13s %.3f %s\n", names[i], match.score,
+		       below ? "ok" : "FAILED, at or above the default threshold");
+		passed = passed && below;
+	}
+	printf("\n");
+	return passed;
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = 50;
+	bool debug_view = false;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--no-opencl") == 0) {
+			cv::ocl::setUseOpenCL(false);
+		} else if (strcmp(argv[i], "--debug-view") == 0) {
+			debug_view = true;
+		} else if ((iterations = atoi(argv[i])) <= 0) {
+			fprintf(stderr, "usage: %s [iterations] [--no-opencl] [--debug-view]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	NccKernel::SelfTest();
+	bool passed = check_noise_scores();
+
+	static CountingAllocator counting_allocator;
+	cv::Mat::setDefaultAllocator(&counting_allocator);
+
+	ThreadPool pool(std::thread::hardware_concurrency());
+	count_allocations(pool);
+	std::unique_ptr<DebugView> view;
+	if (debug_view) {
+		view = std::make_unique<DebugView>();
+		view->SetEnabled(true, "pipeline-bench");
+	}
+
+	const Format formats[] = {
+		{VIDEO_FORMAT_NV12, "NV12"},
+		{VIDEO_FORMAT_I420, "I420"},
+		{VIDEO_FORMAT_YUY2, "YUY2"},
+		{VIDEO_FORMAT_BGRA, "BGRA"},
+	};
+	const Resolution resolutions[] = {
+		{1280, 720, "720p"},
+		{1920, 1080, "1080p"},
+		{3840, 2160, "4K"},
+	};
+	const Scenario scenarios[] = {
+		// Small template in a small region of interest, the direct kernel's case
+		{0.25, 16, 0, false, 1.0},
+		// Exact search of the whole frame, the FFT correlator's case
+		{1.0, 48, 0, false, 1.0},
+		// Typical HUD element anywhere in the frame, coarse to fine search
+		{1.0, 96, 2, false, 1.0},
+		// Same with masked templates, the FFT correlator's masked path
+		{0.25, 16, 0, true, 1.0},
+		{1.0, 48, 0, true, 1.0},
+		{1.0, 96, 2, true, 1.0},
+		// HUD element at an unknown UI scale, the found scale and its neighbours are
+		// searched along with one other scale while the template isn't detected
+		{1.0, 96, 2, false, 1.25},
+	};
+
+	printf("%d iterations, OpenCL %s, times in milliseconds (stage p50, total p50 p99)\n\n",
+	       iterations, cv::ocl::useOpenCL() ? "on" : "off");
+	printf("%-5s %-6s %11s %4s %2s %s %2s  %6s %6s %6s %6s  %13s %7s %8s %6s  %s\n", "fmt",
+	       "res", "region", "tmpl", "pl", "m", "sc", "ingest", "change", "pyr", "match",
+	       "total", "fps", "Mpix/s", "allocs", "found");
+
+	bool allocation_free = true;
+	for (const Resolution &resolution : resolutions)
+		for (const Format &format : formats)
+			for (const Scenario &scenario : scenarios)
+				allocation_free = run(format, resolution, scenario, iterations,
+						      pool, view.get()) &&
+						  allocation_free;
+
+	if (!allocation_free)
+		printf("\nFAILED, frames allocated after the warm up\n");
+	return passed && allocation_free ? 0 : 1;
+}
@@ -0,0 +1,116 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+// Measures how late sleeps to absolute deadlines wake up and how much CPU time the sleeping
+// thread burns meanwhile, for PreciseTimer and std::this_thread::sleep_until.
+//
+// Usage: timer-jitter [iterations]
+
+#include "bench-stats.h"
+#include "timing.h"
+
+#include <util/platform.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <thread>
+#include <vector>
+
+struct Result {
+	std::vector<int64_t> lateness;
+	double cpu_ms;
+	double wall_ms;
+};
+
+static double thread_cpu_ms()
+{
+#ifdef _WIN32
+	return (double)std::clock() * 1000.0 / CLOCKS_PER_SEC;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+#endif
+}
+
+static Result measure(const std::function<uint64_t(uint64_t)> &sleep_until, uint64_t period,
+		      int iterations)
+{
+	Result result;
+	result.lateness.reserve(iterations);
+
+	double cpu_start = thread_cpu_ms();
+	uint64_t start = os_gettime_ns();
+	uint64_t deadline = start;
+	for (int i = 0; i < iterations; i++) {
+		deadline += period;
+		uint64_t woke = sleep_until(deadline);
+		result.lateness.push_back((int64_t)woke - (int64_t)deadline);
+	}
+	result.wall_ms = (double)(os_gettime_ns() - start) / 1e6;
+	result.cpu_ms = thread_cpu_ms() - cpu_start;
+	return result;
+}
+
+static void report(const char *name, uint64_t period, Result &result)
+{
+	Summary s = summarize(result.lateness, 1000.0);
+	printf("%-12s %8.2f %9.1f %9.1f %9.1f %9.1f %9.1f %7.1f%%\n", name, (double)period / 1e6,
+	       s.min, s.mean, s.p50, s.p99, s.max, 100.0 * result.cpu_ms / result.wall_ms);
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 500;
+	if (iterations <= 0) {
+		fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	const uint64_t periods[] = {250000ULL, 1000000ULL, 5000000ULL, 20000000ULL};
+
+	printf("%d deadlines per run, lateness in microseconds, cpu as share of one core\n\n",
+	       iterations);
+	printf("%-12s %8s %9s %9s %9s %9s %9s %8s\n", "timer", "period", "min", "mean", "p50",
+	       "p99", "max", "cpu");
+
+	for (uint64_t period : periods) {
+		PreciseTimer timer;
+		Result precise = measure(
+			[&](uint64_t deadline) { return timer.SleepUntil(deadline); }, period,
+			iterations);
+		report("PreciseTimer", period, precise);
+
+		Result baseline = measure(
+			[](uint64_t deadline) {
+				uint64_t now = os_gettime_ns();
+				if (deadline > now)
+					std::this_thread::sleep_until(
+						std::chrono::steady_clock::now() +
+						std::chrono::nanoseconds(deadline - now));
+				return os_gettime_ns();
+			},
+			period, iterations);
+		report("sleep_until", period, baseline);
+	}
+
+	return 0;
+}
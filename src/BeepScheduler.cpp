@@ -0,0 +1,196 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "BeepScheduler.h"
+#include "template-match-beep.generated.h"
+
+#include <util/platform.h>
+
+#include <algorithm>
+
+#include "vendor/beep/beep.h"
+
+// Waits can be cut short until this long before their deadline, the rest of the wait is left
+// to the precise timer. Condition variables wake up too coarsely to time the audio.
+#define INTERRUPTIBLE_MARGIN 20000000ULL
+
+// A device without a mixer can only be opened once, so every filter plays through one stream
+static std::shared_ptr<BeepStream> shared_stream()
+{
+	static std::mutex mutex;
+	static std::weak_ptr<BeepStream> stream;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	std::shared_ptr<BeepStream> shared = stream.lock();
+	if (!shared) {
+		shared = std::make_shared<BeepStream>();
+		stream = shared;
+	}
+	return shared;
+}
+
+BeepScheduler::BeepScheduler(PipelineStats *stats, DetectionTrace *trace)
+	: m_Stream(shared_stream()),
+	  m_Stats(stats),
+	  m_Trace(trace),
+	  m_QueueEnd(0),
+	  m_PlayingEnd(0),
+	  m_Generation(0),
+	  m_Running(true)
+{
+	m_Thread = std::thread(&BeepScheduler::Loop, this);
+}
+
+BeepScheduler::~BeepScheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Running = false;
+		m_Queue.clear();
+		// The playing sequence stops within a period
+		m_Generation++;
+	}
+	m_Signal.notify_one();
+	m_Thread.join();
+}
+
+void BeepScheduler::Play(BeepSequencePtr sequence, uint64_t start_time, uint64_t frame_time,
+			 uint64_t detection)
+{
+	if (!sequence)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		// Starts once the sequences before it have finished
+		start_time = std::max(start_time, m_QueueEnd);
+		m_QueueEnd = start_time + sequence->duration_ns;
+		m_Queue.push_back({std::move(sequence), start_time, frame_time, detection});
+	}
+	m_Signal.notify_one();
+}
+
+uint64_t BeepScheduler::PlaybackEnd()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_QueueEnd;
+}
+
+void BeepScheduler::Clear()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Queue.clear();
+		m_Generation++;
+		m_QueueEnd = 0;
+		m_PlayingEnd = 0;
+	}
+	m_Signal.notify_one();
+}
+
+void BeepScheduler::Loop()
+{
+	while (true) {
+		Command command;
+		uint64_t generation;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Signal.wait(lock, [this] { return !m_Running || !m_Queue.empty(); });
+			if (!m_Running)
+				return;
+
+			command = std::move(m_Queue.front());
+			m_Queue.pop_front();
+			m_PlayingEnd = command.start_time + command.sequence->duration_ns;
+			generation = m_Generation;
+		}
+
+		const BeepSequence &sequence = *command.sequence;
+		auto cancelled = [this, generation] { return m_Generation != generation; };
+
+		// Pre-rendered segments are submitted as they are, zero copy, each at its offset.
+		// Play blocks until the whole segment is queued, the start is when its first
+		// period was.
+		bool played = true;
+		for (size_t i = 0; played && i < sequence.segments.size(); i++) {
+			const BeepSegment &segment = sequence.segments[i];
+			uint64_t target = command.start_time + segment.offset_ns;
+			if (!waitUntil(target, generation))
+				break;
+			uint64_t started = 0;
+			played = m_Stream->Play(segment, started, cancelled);
+			if (played && i == 0)
+				recordStart(command, target, started);
+		}
+
+		// NOTE: Beep is asynchronous, so events are timed against absolute deadlines
+		// Beep and wait events according to settings
+		uint64_t deadline = command.start_time;
+		bool started = false;
+		for (size_t i = 0; !played && i < sequence.events.size(); i++) {
+			const Event &e = sequence.events[i];
+			if (!waitUntil(deadline, generation))
+				break;
+			if (e.type == EventType::Beep) {
+				// Beep may block for the length of the tone
+				uint64_t beep_start = os_gettime_ns();
+				m_Stream->Beep(e.frequency, e.length);
+				if (!started)
+					recordStart(command, deadline, beep_start);
+				started = true;
+			}
+			deadline += (uint64_t)e.length * 1000000ULL;
+		}
+
+		// Next sequence starts once this one has finished, the sequence is kept alive
+		// until then since the stream may still be reading it. A cancelled one is cut off.
+		if (!waitUntil(command.start_time + sequence.duration_ns, generation))
+			m_Stream->Stop();
+	}
+}
+
+bool BeepScheduler::waitUntil(uint64_t deadline, uint64_t generation)
+{
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		uint64_t now = os_gettime_ns();
+		if (deadline > now + INTERRUPTIBLE_MARGIN) {
+			std::chrono::nanoseconds wait(deadline - now - INTERRUPTIBLE_MARGIN);
+			m_Signal.wait_for(lock, wait, [&] { return m_Generation != generation; });
+		}
+		if (m_Generation != generation)
+			return false;
+	}
+
+	m_Timer.SleepUntil(deadline);
+	return m_Generation == generation;
+}
+
+void BeepScheduler::recordStart(const Command &command, uint64_t target, uint64_t started)
+{
+	if (m_Trace != nullptr && command.detection != 0)
+		m_Trace->AudioStarted(command.detection, started);
+
+	if (m_Stats == nullptr)
+		return;
+
+	m_Stats->Record(PipelineStats::STAGE_PLAYBACK, started > target ? started - target : 0);
+	if (command.frame_time != 0 && command.frame_time <= started &&
+	    started - command.frame_time < MAX_FRAME_LATENCY)
+		m_Stats->Record(PipelineStats::STAGE_LATENCY, started - command.frame_time);
+}
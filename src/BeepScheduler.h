@@ -0,0 +1,99 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef BEEPSCHEDULER_H
+#define BEEPSCHEDULER_H
+
+#include "DetectionTrace.h"
+#include "PipelineStats.h"
+#include "audio.h"
+#include "timing.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class BeepStream;
+
+// Plays event sequences on a dedicated thread. The matcher only queues a sequence with the
+// time it should start at and gets straight back to matching frames.
+class BeepScheduler {
+public:
+	// Playback timings are recorded into stats and audio start times into the trace when
+	// given, both must outlive the scheduler
+	explicit BeepScheduler(PipelineStats *stats = nullptr, DetectionTrace *trace = nullptr);
+	~BeepScheduler();
+
+	BeepScheduler(const BeepScheduler &) = delete;
+	BeepScheduler &operator=(const BeepScheduler &) = delete;
+
+	// Queues the sequence to start at start_time (os_gettime_ns), sequences queued while
+	// another one is playing start once it has finished. Frame time is the timestamp of the
+	// frame the detection was made on and detection its trace id, zero if unknown.
+	void Play(BeepSequencePtr sequence, uint64_t start_time, uint64_t frame_time = 0,
+		  uint64_t detection = 0);
+
+	// Time every queued sequence has finished playing by (os_gettime_ns), in the past once
+	// the scheduler is idle
+	uint64_t PlaybackEnd();
+
+	// Drops the queued sequences and stops the one playing
+	void Clear();
+
+private:
+	struct Command {
+		BeepSequencePtr sequence;
+		uint64_t start_time;
+		uint64_t frame_time;
+		uint64_t detection;
+	};
+
+	void Loop();
+	// Sleeps until the deadline (os_gettime_ns), false if the sequences of the generation
+	// were cancelled meanwhile
+	bool waitUntil(uint64_t deadline, uint64_t generation);
+	// Started is when the first audio of the command was submitted
+	void recordStart(const Command &command, uint64_t target, uint64_t started);
+
+	// Audio output shared by every scheduler, kept open while any of them lives
+	std::shared_ptr<BeepStream> m_Stream;
+
+	// Only used by the scheduler thread, so it calibrates to that thread
+	PreciseTimer m_Timer;
+
+	PipelineStats *m_Stats;
+	DetectionTrace *m_Trace;
+
+	std::deque<Command> m_Queue;
+	// End of the last queued sequence and of the one playing
+	uint64_t m_QueueEnd;
+	uint64_t m_PlayingEnd;
+	// Changed under the lock to cancel the sequence playing, also read without it
+	std::atomic<uint64_t> m_Generation;
+	std::mutex m_Mutex;
+	std::condition_variable m_Signal;
+	bool m_Running;
+	std::thread m_Thread;
+};
+
+#endif // !BEEPSCHEDULER_H
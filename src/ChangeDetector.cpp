@@ -0,0 +1,53 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "ChangeDetector.h"
+
+#include <algorithm>
+
+// Cells of the signature in each direction at least, every cell is the mean of its area so
+// noise averages out while local changes such as a digit flipping still move a cell
+#define SIGNATURE_SIZE 16
+
+bool ChangeDetector::Changed(const cv::Mat &gray, const cv::Rect &region, cv::Size max_cell,
+			     double threshold)
+{
+	max_cell.width = std::max(max_cell.width, 1);
+	max_cell.height = std::max(max_cell.height, 1);
+	cv::Size size(std::max((gray.cols + max_cell.width - 1) / max_cell.width, SIGNATURE_SIZE),
+		      std::max((gray.rows + max_cell.height - 1) / max_cell.height, SIGNATURE_SIZE));
+	size.width = std::min(size.width, gray.cols);
+	size.height = std::min(size.height, gray.rows);
+	cv::resize(gray, m_Current, size, 0, 0, cv::INTER_AREA);
+
+	bool changed = m_Signature.empty() || region != m_Region ||
+		       m_Signature.size() != m_Current.size() ||
+		       cv::norm(m_Current, m_Signature, cv::NORM_INF) > threshold;
+	if (changed) {
+		std::swap(m_Current, m_Signature);
+		m_Region = region;
+	}
+
+	return changed;
+}
+
+void ChangeDetector::Reset()
+{
+	// Signature keeps its buffer for the next frame, no region of it is ever empty
+	m_Region = cv::Rect();
+}
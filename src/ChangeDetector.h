@@ -0,0 +1,48 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef CHANGEDETECTOR_H
+#define CHANGEDETECTOR_H
+
+#ifdef __cplusplus
+#undef NO
+#undef YES
+#include <opencv2/opencv.hpp>
+#endif
+
+// Tells if the searched region changed since it was last matched, by comparing a small
+// downscaled signature of it. Static scenes can then reuse the previous match results.
+class ChangeDetector {
+public:
+	// Threshold is the largest difference in gray levels of any signature cell that still
+	// counts as unchanged. The signature is only replaced when a change is detected, so slow
+	// drift adds up until it is noticed. Cells are at most max_cell in size, a change within a
+	// cell is diluted by the rest of it, so it should be well under the smallest template.
+	bool Changed(const cv::Mat &gray, const cv::Rect &region, cv::Size max_cell,
+		     double threshold);
+
+	// Next frame is always treated as changed
+	void Reset();
+
+private:
+	cv::Rect m_Region;
+	cv::Mat m_Signature;
+	cv::Mat m_Current;
+};
+
+#endif // !CHANGEDETECTOR_H
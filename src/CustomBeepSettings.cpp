@@ -18,7 +18,6 @@ with this program. If not, see <https://www.gnu.org/licenses/>
 
 #include "CustomBeepSettings.h"
 #include "template-match-beep.generated.h"
-#include "audio.h"
 
 MouseWheelWidgetAdjustmentGuard::MouseWheelWidgetAdjustmentGuard(QObject *parent) : QObject(parent)
 {
@@ -132,8 +131,9 @@ void ArrayItemWidget::removeClicked()
 	delete this;
 }
 
-CustomBeepSettings::CustomBeepSettings(QObject *parent)
+CustomBeepSettings::CustomBeepSettings(const char *array_name, QObject *parent)
 	: QObject(parent),
+	  m_ArrayName(array_name),
 	  m_Settings(nullptr),
 	  m_Button(nullptr),
 	  m_List(nullptr),
@@ -144,21 +144,26 @@ CustomBeepSettings::CustomBeepSettings(QObject *parent)
 {
 }
 
-CustomBeepSettings::~CustomBeepSettings() {}
+CustomBeepSettings::~CustomBeepSettings()
+{
+	// An open settings window goes with its filter, once the UI thread gets to it
+	if (m_Window != nullptr)
+		m_Window->deleteLater();
+	obs_data_array_release(m_Settings);
+}
 
 void CustomBeepSettings::CreateOBSSettings(obs_data_t *settings)
 {
-	m_Settings = obs_data_get_array(settings, SETTING_EVENT_ARRAY);
+	// Called on every update, so drop the reference taken by the previous call
+	obs_data_array_release(m_Settings);
+
+	m_Settings = obs_data_get_array(settings, m_ArrayName.c_str());
 	if (m_Settings == nullptr) {
 		m_Settings = obs_data_array_create();
-		obs_data_set_array(settings, SETTING_EVENT_ARRAY, m_Settings);
-	}
-	// Create the beeps to cache
-	for (Event e : GetEvents()) {
-		if (e.type == EventType::Beep) {
-			CreateBeep(e.length * MSEC_TO_SEC, e.frequency, 1.0f);
-		}
+		obs_data_set_array(settings, m_ArrayName.c_str(), m_Settings);
 	}
+	// Render the whole sequence up front, playback only submits it
+	UpdateSequence();
 }
 
 void CustomBeepSettings::LoadSettings()
@@ -217,6 +222,7 @@ void CustomBeepSettings::ShowSettingsWindow()
 void CustomBeepSettings::DeleteArrayItem(ArrayItemWidget *widget)
 {
 	obs_data_array_erase(m_Settings, m_List->indexOf(widget));
+	UpdateSequence();
 }
 
 void CustomBeepSettings::ChangedArrayItem(ArrayItemWidget *widget, const char *name, int value)
@@ -224,6 +230,7 @@ void CustomBeepSettings::ChangedArrayItem(ArrayItemWidget *widget, const char *n
 	int index = m_List->indexOf(widget);
 	obs_data_t *item = obs_data_array_item(m_Settings, index);
 	obs_data_set_int(item, name, value);
+	UpdateSequence();
 }
 
 std::vector<Event> CustomBeepSettings::GetEvents()
@@ -236,12 +243,27 @@ std::vector<Event> CustomBeepSettings::GetEvents()
 		current.type = static_cast<EventType>(obs_data_get_int(item, SETTING_EVENT_TYPE));
 		current.length = obs_data_get_int(item, SETTING_EVENT_LENGTH);
 		current.frequency = obs_data_get_int(item, SETTING_EVENT_FREQUENCY);
+		obs_data_release(item);
 		events.push_back(current);
 	}
 
 	return events;
 }
 
+BeepSequencePtr CustomBeepSettings::GetSequence()
+{
+	std::lock_guard<std::mutex> lock(m_SequenceMutex);
+	return m_Sequence;
+}
+
+void CustomBeepSettings::UpdateSequence()
+{
+	BeepSequencePtr sequence = CreateSequence(GetEvents());
+
+	std::lock_guard<std::mutex> lock(m_SequenceMutex);
+	m_Sequence = sequence;
+}
+
 void CustomBeepSettings::WindowClosed(int result)
 {
 	delete m_Window;
@@ -253,6 +275,7 @@ void CustomBeepSettings::addNewEvent()
 {
 	obs_data_array_push_back(m_Settings, CreateArrayItem(EventType::Beep));
 	m_List->addWidget(new ArrayItemWidget(this, m_Window));
+	UpdateSequence();
 }
 
 obs_data_t *CustomBeepSettings::CreateArrayItem(EventType type)
@@ -26,6 +26,10 @@ with this program. If not, see <https://www.gnu.org/licenses/>
 #include <util/base.h>
 #include <obs-data.h>
 #include <QtWidgets>
+#include <mutex>
+#include <string>
+
+#include "audio.h"
 
 #define SETTING_EVENT_ARRAY "event_array"
 
@@ -41,13 +45,6 @@ protected:
 	bool eventFilter(QObject *o, QEvent *e) override;
 };
 
-enum class EventType { Beep, Wait };
-
-struct Event {
-	EventType type;
-	int length;
-	int frequency;
-};
 class CustomBeepSettings;
 
 class ArrayItemWidget : public QWidget {
@@ -76,7 +73,8 @@ private:
 class CustomBeepSettings : public QObject {
 	Q_OBJECT
 public:
-	CustomBeepSettings(QObject *parent = nullptr);
+	// Events are stored in the array setting of the given name
+	CustomBeepSettings(const char *array_name, QObject *parent = nullptr);
 	~CustomBeepSettings();
 
 	void CreateOBSSettings(obs_data_t *settings);
@@ -91,18 +89,27 @@ public:
 
 	std::vector<Event> GetEvents();
 
+	// Events rendered when the settings were created or last edited, safe from any thread
+	BeepSequencePtr GetSequence();
+
 private slots:
 	void WindowClosed(int result);
 
 private:
 	void addNewEvent();
 
+	void UpdateSequence();
+
 	obs_data_t *CreateArrayItem(EventType type);
 
 	void SetArrayItemType(obs_data_t *item, EventType type);
 
+	std::string m_ArrayName;
 	obs_data_array_t *m_Settings;
 
+	std::mutex m_SequenceMutex;
+	BeepSequencePtr m_Sequence;
+
 	QPushButton *m_Button;
 	QVBoxLayout *m_List;
 	QVBoxLayout *m_MainLayout;
@@ -0,0 +1,183 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "DebugView.h"
+
+#include <chrono>
+#include <cstdio>
+#include <limits>
+
+#ifndef SEC_TO_NSEC
+#define SEC_TO_NSEC 1000000000ULL
+#endif
+
+// Snapshots shown per second at most, the copy and drawing are only paid this often
+#define DEBUG_VIEW_RATE 15
+// Window events are handled at least this often while no snapshots arrive
+#define DEBUG_VIEW_EVENT_INTERVAL std::chrono::milliseconds(50)
+
+DebugView::DebugView()
+	: m_Running(false),
+	  m_Next(std::numeric_limits<uint64_t>::max()),
+	  m_Back{cv::Mat(), {}, 0},
+	  m_Fresh(false),
+	  m_Front{cv::Mat(), {}, 0}
+{
+}
+
+DebugView::~DebugView()
+{
+	SetEnabled(false, "");
+}
+
+void DebugView::SetEnabled(bool enabled, const std::string &name)
+{
+	if (enabled == m_Thread.joinable() && (!enabled || name == m_Name))
+		return;
+
+	if (m_Thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Running = false;
+			m_Next = std::numeric_limits<uint64_t>::max();
+		}
+		m_Signal.notify_one();
+		m_Thread.join();
+	}
+
+	if (!enabled)
+		return;
+
+	// The match job may be presenting at the same time
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Name = name;
+		m_Fresh = false;
+		m_Running = true;
+		m_Next = 0;
+	}
+	m_Thread = std::thread(&DebugView::Loop, this);
+}
+
+bool DebugView::Wanted(uint64_t now) const
+{
+	return now >= m_Next;
+}
+
+void DebugView::Present(const cv::Mat &gray, const std::vector<DebugMatch> &matches,
+			uint64_t analysis_time, uint64_t now)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (!m_Running)
+			return;
+
+		// Buffers keep their capacity, so this only allocates when the frame size changes.
+		// Score maps are copied too, the matcher overwrites its own on the next frame.
+		gray.copyTo(m_Back.gray);
+		m_Back.matches.resize(matches.size());
+		for (size_t i = 0; i < matches.size(); i++) {
+			DebugMatch &back = m_Back.matches[i];
+			back.rect = matches[i].rect;
+			back.score = matches[i].score;
+			back.detected = matches[i].detected;
+			back.suppressed = matches[i].suppressed;
+			back.score_area = matches[i].score_area;
+			if (back.score_area.empty())
+				continue;
+			matches[i].score_map.copyTo(back.score_map);
+		}
+		m_Back.analysis_time = analysis_time;
+		m_Fresh = true;
+		m_Next = now + SEC_TO_NSEC / DEBUG_VIEW_RATE;
+	}
+	m_Signal.notify_one();
+}
+
+void DebugView::Loop()
+{
+	bool shown = false;
+
+	while (true) {
+		bool fresh = false;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Signal.wait_for(lock, DEBUG_VIEW_EVENT_INTERVAL,
+					  [this] { return !m_Running || m_Fresh; });
+			if (!m_Running)
+				break;
+
+			if (m_Fresh) {
+				std::swap(m_Front, m_Back);
+				m_Fresh = false;
+				fresh = true;
+			}
+		}
+
+		if (fresh) {
+			render(m_Front);
+			shown = true;
+		}
+
+		// HighGUI only handles the window's events while it is waited on
+		if (shown)
+			cv::waitKey(1);
+	}
+
+	if (shown)
+		cv::destroyWindow(m_Name);
+}
+
+void DebugView::render(const Snapshot &snapshot)
+{
+	cv::cvtColor(snapshot.gray, m_Canvas, cv::COLOR_GRAY2BGR);
+
+	// Scores from -1 to 1 as a heat map blended over the positions they were scored at
+	const cv::Rect bounds(cv::Point(), m_Canvas.size());
+	for (const DebugMatch &match : snapshot.matches) {
+		cv::Rect area = match.score_area & bounds;
+		if (area.empty() || match.score_map.empty())
+			continue;
+
+		match.score_map.convertTo(m_Scores, CV_8U, 127.5, 127.5);
+		cv::resize(m_Scores, m_Heat, match.score_area.size(), 0, 0, cv::INTER_NEAREST);
+		cv::applyColorMap(m_Heat(area - match.score_area.tl()), m_HeatColor,
+				  cv::COLORMAP_JET);
+		cv::Mat target = m_Canvas(area);
+		cv::addWeighted(target, 0.6, m_HeatColor, 0.4, 0.0, target);
+	}
+
+	char text[64];
+	for (const DebugMatch &match : snapshot.matches) {
+		// Green beeped, orange held back by the cooldown, red best location below threshold
+		cv::Scalar color = !match.detected  ? cv::Scalar(0, 0, 255)
+				   : match.suppressed ? cv::Scalar(0, 165, 255)
+						      : cv::Scalar(0, 255, 0);
+		cv::rectangle(m_Canvas, match.rect, color, match.detected ? 2 : 1);
+
+		snprintf(text, sizeof(text), "%.3f", match.score);
+		cv::putText(m_Canvas, text, match.rect.tl() + cv::Point(0, -4),
+			    cv::FONT_HERSHEY_SIMPLEX, 0.4, color, 1);
+	}
+
+	snprintf(text, sizeof(text), "analysis %.2f ms", snapshot.analysis_time / 1000000.0);
+	cv::putText(m_Canvas, text, cv::Point(4, 14), cv::FONT_HERSHEY_SIMPLEX, 0.4,
+		    cv::Scalar(255, 255, 0), 1);
+
+	cv::imshow(m_Name, m_Canvas);
+}
@@ -0,0 +1,102 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef DEBUGVIEW_H
+#define DEBUGVIEW_H
+
+#ifdef __cplusplus
+#undef NO
+#undef YES
+#include <opencv2/opencv.hpp>
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Best match of one template on the presented frame
+struct DebugMatch {
+	// In the coordinates of the presented image
+	cv::Rect rect;
+	double score;
+	bool detected;
+	// Detected, but held back by the cooldown
+	bool suppressed;
+	// Downscaled scores of the positions in the score area, empty without one
+	cv::Mat score_map;
+	cv::Rect score_area;
+};
+
+// Shows what the matcher sees in a HighGUI window drawn by its own thread, so neither the
+// OBS video callback nor the match job ever waits for the window. The match job hands over
+// a snapshot into the back buffer, the presenter swaps it to the front at its own rate.
+class DebugView {
+public:
+	DebugView();
+	~DebugView();
+
+	DebugView(const DebugView &) = delete;
+	DebugView &operator=(const DebugView &) = delete;
+
+	// Starts the presenter with a window of the given name, or stops it and closes the window
+	void SetEnabled(bool enabled, const std::string &name);
+
+	// Snapshot is wanted at now (os_gettime_ns), so the caller can skip preparing one
+	bool Wanted(uint64_t now) const;
+
+	// Copies the gray frame and the matches with their score maps into the back buffer,
+	// replacing any snapshot not yet shown. Analysis time is the nanoseconds the frame took
+	// to match.
+	void Present(const cv::Mat &gray, const std::vector<DebugMatch> &matches,
+		     uint64_t analysis_time, uint64_t now);
+
+private:
+	struct Snapshot {
+		cv::Mat gray;
+		std::vector<DebugMatch> matches;
+		uint64_t analysis_time;
+	};
+
+	void Loop();
+	void render(const Snapshot &snapshot);
+
+	std::string m_Name;
+	std::thread m_Thread;
+	bool m_Running;
+
+	// Time the presenter takes the next snapshot at, read without the lock by Wanted
+	std::atomic<uint64_t> m_Next;
+
+	Snapshot m_Back;
+	bool m_Fresh;
+	std::mutex m_Mutex;
+	std::condition_variable m_Signal;
+
+	// Only touched by the presenter thread
+	Snapshot m_Front;
+	cv::Mat m_Canvas;
+	cv::Mat m_Scores;
+	cv::Mat m_Heat;
+	cv::Mat m_HeatColor;
+};
+
+#endif // !DEBUGVIEW_H
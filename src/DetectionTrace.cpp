@@ -0,0 +1,100 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "DetectionTrace.h"
+#include "timing.h"
+
+#include <util/platform.h>
+
+#include <algorithm>
+#include <cstdio>
+
+DetectionTrace::DetectionTrace(size_t capacity) : m_Records(capacity, Record()), m_NextId(1) {}
+
+uint64_t DetectionTrace::Add(size_t slot, double score, int x, int y, bool suppressed,
+			     uint64_t frame_time, uint64_t match_time)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	uint64_t id = m_NextId++;
+	Record &record = m_Records[id % m_Records.size()];
+	record.id = id;
+	record.slot = slot;
+	record.score = score;
+	record.x = x;
+	record.y = y;
+	record.suppressed = suppressed;
+	record.frame_time = frame_time;
+	record.match_time = match_time;
+	record.audio_time = 0;
+	return id;
+}
+
+void DetectionTrace::AudioStarted(uint64_t id, uint64_t time)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	Record &record = m_Records[id % m_Records.size()];
+	if (record.id == id)
+		record.audio_time = time;
+}
+
+size_t DetectionTrace::Size() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return (size_t)std::min<uint64_t>(m_NextId - 1, m_Records.size());
+}
+
+// Milliseconds from start to end, empty if either is unknown or they aren't on the same clock
+static std::string latency(uint64_t start, uint64_t end)
+{
+	if (start == 0 || end == 0 || end < start || end - start >= MAX_FRAME_LATENCY)
+		return "";
+
+	char text[32];
+	snprintf(text, sizeof(text), "%.3f", (double)(end - start) / 1000000.0);
+	return text;
+}
+
+bool DetectionTrace::WriteCsv(const std::string &path) const
+{
+	// Copied so writing the file doesn't hold up the matcher
+	std::vector<Record> records;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (uint64_t id = m_NextId > m_Records.size() ? m_NextId - m_Records.size() : 1;
+		     id < m_NextId; id++)
+			records.push_back(m_Records[id % m_Records.size()]);
+	}
+
+	FILE *file = os_fopen(path.c_str(), "w");
+	if (file == nullptr)
+		return false;
+
+	fprintf(file, "id,slot,score,x,y,suppressed,frame_time,match_time,audio_time,"
+		      "frame_to_match_ms,match_to_audio_ms,frame_to_audio_ms\n");
+	for (const Record &r : records) {
+		fprintf(file, "%llu,%zu,%.4f,%d,%d,%d,%llu,%llu,%llu,%s,%s,%s\n",
+			(unsigned long long)r.id, r.slot, r.score, r.x, r.y, r.suppressed ? 1 : 0,
+			(unsigned long long)r.frame_time, (unsigned long long)r.match_time,
+			(unsigned long long)r.audio_time,
+			latency(r.frame_time, r.match_time).c_str(),
+			latency(r.match_time, r.audio_time).c_str(),
+			latency(r.frame_time, r.audio_time).c_str());
+	}
+
+	return fclose(file) == 0;
+}
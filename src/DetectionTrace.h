@@ -0,0 +1,68 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef DETECTIONTRACE_H
+#define DETECTIONTRACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Ring buffer of the latest detections of a filter with the times they went through the
+// pipeline, for measuring the capture to beep latency. Times are os_gettime_ns nanoseconds,
+// the frame time is the source's timestamp of the detected frame.
+class DetectionTrace {
+public:
+	struct Record {
+		uint64_t id;
+		size_t slot;
+		double score;
+		int x, y;
+		// Held back by the cooldown, so no audio follows
+		bool suppressed;
+		uint64_t frame_time;
+		uint64_t match_time;
+		// Zero until the scheduler has submitted the sequence
+		uint64_t audio_time;
+	};
+
+	explicit DetectionTrace(size_t capacity);
+
+	// Returns the id of the record, never zero
+	uint64_t Add(size_t slot, double score, int x, int y, bool suppressed, uint64_t frame_time,
+		     uint64_t match_time);
+
+	// Nothing happens if the record was already overwritten
+	void AudioStarted(uint64_t id, uint64_t time);
+
+	// Oldest record first, with the latencies in milliseconds. Returns false if the file
+	// couldn't be written.
+	bool WriteCsv(const std::string &path) const;
+
+	size_t Size() const;
+
+private:
+	std::vector<Record> m_Records;
+	uint64_t m_NextId;
+
+	mutable std::mutex m_Mutex;
+};
+
+#endif // !DETECTIONTRACE_H
@@ -0,0 +1,159 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "FftCorrelator.h"
+
+#include <algorithm>
+#include <cmath>
+
+FftCorrelator::FftCorrelator(const cv::Mat &templ, const cv::Mat &mask)
+	: m_TemplateNorm(0.0), m_MaskCount((double)templ.total())
+{
+	templ.convertTo(m_Template, CV_32F);
+	if (mask.empty()) {
+		m_Template -= cv::mean(m_Template);
+	} else {
+		// Zero-mean under the mask, so the mean of the image under it cancels out too
+		m_Mask = cv::Mat::zeros(templ.size(), CV_32F);
+		m_Mask.setTo(1.0f, mask);
+		m_MaskCount = (double)cv::countNonZero(mask);
+		m_Template -= cv::mean(m_Template, mask);
+		m_Template = m_Template.mul(m_Mask);
+	}
+	m_TemplateNorm = cv::norm(m_Template, cv::NORM_L2);
+}
+
+void FftCorrelator::prepare(cv::Size image_size)
+{
+	m_ImageSize = image_size;
+
+	// Correlation never wraps around since valid positions keep the template inside the image
+	cv::Size dft_size(cv::getOptimalDFTSize(image_size.width),
+			  cv::getOptimalDFTSize(image_size.height));
+
+	cv::Mat padded = cv::Mat::zeros(dft_size, CV_32F);
+	m_Template.copyTo(padded(cv::Rect(cv::Point(), m_Template.size())));
+	cv::dft(padded, m_TemplateSpectrum, 0, m_Template.rows);
+
+	if (!m_Mask.empty()) {
+		m_Mask.copyTo(padded(cv::Rect(cv::Point(), m_Mask.size())));
+		cv::dft(padded, m_MaskSpectrum, 0, m_Mask.rows);
+		m_PaddedSq = cv::Mat::zeros(dft_size, CV_32F);
+	}
+
+	// Only the image area is overwritten per frame, the padding stays zero
+	m_Padded = cv::Mat::zeros(dft_size, CV_32F);
+}
+
+void FftCorrelator::Match(const cv::Mat &image, cv::Mat &result)
+{
+	if (image.size() != m_ImageSize)
+		prepare(image.size());
+
+	if (!m_Mask.empty()) {
+		matchMasked(image, result);
+		return;
+	}
+
+	const int width = m_Template.cols;
+	const int height = m_Template.rows;
+	cv::Size result_size(image.cols - width + 1, image.rows - height + 1);
+
+	// Sum of image times zero-mean template equals the sum of the zero-mean image times it
+	cv::Mat image_area = m_Padded(cv::Rect(cv::Point(), image.size()));
+	image.convertTo(image_area, CV_32F);
+	cv::dft(m_Padded, m_Spectrum, 0, image.rows);
+	cv::mulSpectrums(m_Spectrum, m_TemplateSpectrum, m_Spectrum, 0, true);
+	cv::idft(m_Spectrum, m_Correlation, cv::DFT_SCALE | cv::DFT_REAL_OUTPUT,
+		 result_size.height);
+
+	cv::integral(image, m_Sum, m_SqSum, CV_64F, CV_64F);
+
+	const double count = (double)width * height;
+	result.create(result_size, CV_32F);
+	for (int y = 0; y < result_size.height; y++) {
+		const double *sum_top = m_Sum.ptr<double>(y);
+		const double *sum_bottom = m_Sum.ptr<double>(y + height);
+		const double *sqsum_top = m_SqSum.ptr<double>(y);
+		const double *sqsum_bottom = m_SqSum.ptr<double>(y + height);
+		const float *correlation = m_Correlation.ptr<float>(y);
+		float *scores = result.ptr<float>(y);
+
+		for (int x = 0; x < result_size.width; x++) {
+			double sum = sum_bottom[x + width] - sum_bottom[x] - sum_top[x + width] +
+				     sum_top[x];
+			double sqsum = sqsum_bottom[x + width] - sqsum_bottom[x] -
+				       sqsum_top[x + width] + sqsum_top[x];
+			// Window that isn't flat has a variance sum of at least (n - 1) / n
+			double variance = sqsum - sum * sum / count;
+			if (variance < 0.5 || m_TemplateNorm <= 0.0) {
+				scores[x] = 0.0f;
+				continue;
+			}
+
+			double score = correlation[x] / (std::sqrt(variance) * m_TemplateNorm);
+			scores[x] = (float)std::min(std::max(score, -1.0), 1.0);
+		}
+	}
+}
+
+void FftCorrelator::matchMasked(const cv::Mat &image, cv::Mat &result)
+{
+	cv::Size result_size(image.cols - m_Template.cols + 1, image.rows - m_Template.rows + 1);
+	const int flags = cv::DFT_SCALE | cv::DFT_REAL_OUTPUT;
+
+	// Shifting the image by its mean doesn't change any score, but keeps the squared sums
+	// small enough for single precision
+	double offset = cv::mean(image)[0];
+	cv::Mat image_area = m_Padded(cv::Rect(cv::Point(), image.size()));
+	image.convertTo(image_area, CV_32F, 1.0, -offset);
+	cv::dft(m_Padded, m_Spectrum, 0, image.rows);
+
+	cv::mulSpectrums(m_Spectrum, m_TemplateSpectrum, m_Product, 0, true);
+	cv::idft(m_Product, m_Correlation, flags, result_size.height);
+
+	// Sums of the image under the mask at every position
+	cv::mulSpectrums(m_Spectrum, m_MaskSpectrum, m_Product, 0, true);
+	cv::idft(m_Product, m_Sum, flags, result_size.height);
+
+	cv::Mat squared_area = m_PaddedSq(cv::Rect(cv::Point(), image.size()));
+	cv::multiply(image_area, image_area, squared_area);
+	cv::dft(m_PaddedSq, m_Spectrum, 0, image.rows);
+	cv::mulSpectrums(m_Spectrum, m_MaskSpectrum, m_Product, 0, true);
+	cv::idft(m_Product, m_SqSum, flags, result_size.height);
+
+	result.create(result_size, CV_32F);
+	for (int y = 0; y < result_size.height; y++) {
+		const float *sums = m_Sum.ptr<float>(y);
+		const float *sqsums = m_SqSum.ptr<float>(y);
+		const float *correlation = m_Correlation.ptr<float>(y);
+		float *scores = result.ptr<float>(y);
+
+		for (int x = 0; x < result_size.width; x++) {
+			double sum = sums[x];
+			double variance = sqsums[x] - sum * sum / m_MaskCount;
+			if (variance < 0.5 || m_TemplateNorm <= 0.0) {
+				scores[x] = 0.0f;
+				continue;
+			}
+
+			double score = correlation[x] / (std::sqrt(variance) * m_TemplateNorm);
+			scores[x] = (float)std::min(std::max(score, -1.0), 1.0);
+		}
+	}
+}
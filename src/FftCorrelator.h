@@ -0,0 +1,70 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef FFTCORRELATOR_H
+#define FFTCORRELATOR_H
+
+#ifdef __cplusplus
+#undef NO
+#undef YES
+#include <opencv2/opencv.hpp>
+#endif
+
+// Normalized correlation coefficient (TM_CCOEFF_NORMED) of one template through the frequency
+// domain. Template statistics are computed once and its spectrum once per search image size,
+// so a frame costs one forward DFT, a spectrum multiplication and one inverse DFT. The local
+// sums of the image come from integral images.
+//
+// With a mask only the template pixels under it count. The local sums of the image under the
+// mask are correlations too, so a frame costs two forward and three inverse DFTs.
+class FftCorrelator {
+public:
+	// Mask is 8-bit, nonzero where the template counts, or empty to use every pixel
+	FftCorrelator(const cv::Mat &templ, const cv::Mat &mask);
+
+	// Scores every position of the template in the 8-bit gray image into result
+	void Match(const cv::Mat &image, cv::Mat &result);
+
+private:
+	void prepare(cv::Size image_size);
+	void matchMasked(const cv::Mat &image, cv::Mat &result);
+
+	// Template with its mean subtracted and the norm of that, zero outside the mask
+	cv::Mat m_Template;
+	double m_TemplateNorm;
+
+	// Ones under the mask, empty without one
+	cv::Mat m_Mask;
+	double m_MaskCount;
+
+	// Image size the template spectrum was computed for
+	cv::Size m_ImageSize;
+	cv::Mat m_TemplateSpectrum;
+	cv::Mat m_MaskSpectrum;
+
+	// Reused while the image size stays the same
+	cv::Mat m_Padded;
+	cv::Mat m_Spectrum;
+	cv::Mat m_Correlation;
+	cv::Mat m_Sum;
+	cv::Mat m_SqSum;
+	cv::Mat m_PaddedSq;
+	cv::Mat m_Product;
+};
+
+#endif // !FFTCORRELATOR_H
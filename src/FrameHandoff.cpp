@@ -0,0 +1,160 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "FrameHandoff.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Rows of the plane per image row as a shift, chroma of 4:2:0 formats has half the rows.
+// False for formats whose layout isn't known here.
+static bool plane_row_shift(video_format format, size_t plane, uint32_t &shift)
+{
+	switch (format) {
+	case VIDEO_FORMAT_I420:
+	case VIDEO_FORMAT_I40A:
+		shift = plane == 1 || plane == 2 ? 1 : 0;
+		return true;
+	case VIDEO_FORMAT_NV12:
+		shift = plane == 1 ? 1 : 0;
+		return true;
+	case VIDEO_FORMAT_I444:
+	case VIDEO_FORMAT_I422:
+	case VIDEO_FORMAT_I42A:
+	case VIDEO_FORMAT_YUVA:
+	case VIDEO_FORMAT_YVYU:
+	case VIDEO_FORMAT_YUY2:
+	case VIDEO_FORMAT_UYVY:
+	case VIDEO_FORMAT_AYUV:
+	case VIDEO_FORMAT_Y800:
+	case VIDEO_FORMAT_RGBA:
+	case VIDEO_FORMAT_BGRX:
+	case VIDEO_FORMAT_BGRA:
+	case VIDEO_FORMAT_BGR3:
+		shift = 0;
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Copies the image rows of every plane line by line, the linesizes of the frames may differ
+static bool copy_rows(obs_source_frame *dst, const obs_source_frame *src, FrameRows rows)
+{
+	for (size_t plane = 0; plane < MAX_AV_PLANES && src->data[plane] != nullptr; plane++) {
+		uint32_t shift;
+		if (!plane_row_shift(src->format, plane, shift) || dst->data[plane] == nullptr)
+			return false;
+	}
+
+	dst->timestamp = src->timestamp;
+	dst->full_range = src->full_range;
+	dst->flip = src->flip;
+	memcpy(dst->color_matrix, src->color_matrix, sizeof(dst->color_matrix));
+	memcpy(dst->color_range_min, src->color_range_min, sizeof(dst->color_range_min));
+	memcpy(dst->color_range_max, src->color_range_max, sizeof(dst->color_range_max));
+
+	for (size_t plane = 0; plane < MAX_AV_PLANES && src->data[plane] != nullptr; plane++) {
+		uint32_t shift = 0;
+		plane_row_shift(src->format, plane, shift);
+		// Subsampled rows shared with the rows around the range are copied too
+		uint32_t first = rows.first >> shift;
+		uint32_t end = (rows.first + rows.count + (1u << shift) - 1) >> shift;
+		size_t length = std::min(src->linesize[plane], dst->linesize[plane]);
+		for (uint32_t row = first; row < end; row++)
+			memcpy(dst->data[plane] + (size_t)row * dst->linesize[plane],
+			       src->data[plane] + (size_t)row * src->linesize[plane], length);
+	}
+
+	return true;
+}
+
+FrameHandoff::FrameHandoff()
+	: m_Frames{nullptr, nullptr, nullptr},
+	  m_Rows{ALL_ROWS, ALL_ROWS, ALL_ROWS},
+	  m_Middle(1),
+	  m_Back(0),
+	  m_Front(2),
+	  m_FrontValid(false)
+{
+}
+
+FrameHandoff::~FrameHandoff()
+{
+	for (obs_source_frame *frame : m_Frames)
+		obs_source_frame_destroy(frame);
+}
+
+bool FrameHandoff::Publish(const obs_source_frame *frame, FrameRows rows)
+{
+	// The back buffer belongs to the producer, so it can be written without locking
+	obs_source_frame *&back = m_Frames[m_Back];
+	if (back == nullptr || back->format != frame->format || back->width != frame->width ||
+	    back->height != frame->height) {
+		obs_source_frame_destroy(back);
+		back = obs_source_frame_create(frame->format, frame->width, frame->height);
+	}
+
+	rows.first = std::min(rows.first, frame->height);
+	rows.count = std::min(rows.count, frame->height - rows.first);
+	if (rows.count == frame->height || !copy_rows(back, frame, rows)) {
+		obs_source_frame_copy(back, frame);
+		rows = {0, frame->height};
+	}
+	m_Rows[m_Back] = rows;
+
+	uint8_t previous = m_Middle.exchange(m_Back | DIRTY_FLAG);
+	m_Back = previous & INDEX_MASK;
+	return (previous & DIRTY_FLAG) != 0;
+}
+
+const obs_source_frame *FrameHandoff::Acquire()
+{
+	if (!Pending())
+		return nullptr;
+
+	std::lock_guard<std::mutex> lock(m_FrontMutex);
+	m_Front = m_Middle.exchange(m_Front) & INDEX_MASK;
+	m_FrontValid = true;
+	return m_Frames[m_Front];
+}
+
+FrameRows FrameHandoff::AcquiredRows() const
+{
+	return m_Rows[m_Front];
+}
+
+void FrameHandoff::ReadAcquired(
+	const std::function<void(const obs_source_frame *, FrameRows)> &reader)
+{
+	std::lock_guard<std::mutex> lock(m_FrontMutex);
+	reader(m_FrontValid ? m_Frames[m_Front] : nullptr, m_Rows[m_Front]);
+}
+
+bool FrameHandoff::Pending() const
+{
+	return (m_Middle.load() & DIRTY_FLAG) != 0;
+}
+
+void FrameHandoff::Clear()
+{
+	m_Middle.fetch_and(INDEX_MASK);
+
+	std::lock_guard<std::mutex> lock(m_FrontMutex);
+	m_FrontValid = false;
+}
@@ -0,0 +1,84 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef FRAMEHANDOFF_H
+#define FRAMEHANDOFF_H
+
+#include <obs-module.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+// Rows of a frame image from the top, count is clamped to the frame height
+struct FrameRows {
+	uint32_t first;
+	uint32_t count;
+};
+
+// Hands the latest frame from the OBS video callback (single producer) to the match job
+// (single consumer) through a triple buffer. Frames are copied on publish, so the consumer
+// never reads a frame OBS has already recycled, and neither side ever waits for the other.
+class FrameHandoff {
+public:
+	static constexpr FrameRows ALL_ROWS = {0, UINT32_MAX};
+
+	FrameHandoff();
+	~FrameHandoff();
+
+	FrameHandoff(const FrameHandoff &) = delete;
+	FrameHandoff &operator=(const FrameHandoff &) = delete;
+
+	// Copies the rows of the frame and makes it the latest one, replacing any frame not yet
+	// acquired. The other rows of the copy are left stale, so the video thread only copies
+	// what will be matched. Returns true if an unread frame was replaced.
+	bool Publish(const obs_source_frame *frame, FrameRows rows = ALL_ROWS);
+
+	// Takes the frame published after the previously acquired one, nullptr if there is none.
+	// The returned frame stays valid until the next Acquire.
+	const obs_source_frame *Acquire();
+	// Rows of the acquired frame that were copied
+	FrameRows AcquiredRows() const;
+
+	// A frame was published that hasn't been acquired yet
+	bool Pending() const;
+
+	// Runs the reader on the most recently acquired frame (nullptr if none) and its copied
+	// rows, keeping the consumer from swapping it out meanwhile
+	void ReadAcquired(const std::function<void(const obs_source_frame *, FrameRows)> &reader);
+
+	// Forgets the published frames, only called while there is no consumer
+	void Clear();
+
+private:
+	static constexpr uint8_t INDEX_MASK = 0x3;
+	static constexpr uint8_t DIRTY_FLAG = 0x4;
+
+	obs_source_frame *m_Frames[3];
+	FrameRows m_Rows[3];
+
+	// Index of the middle buffer, with the dirty flag set when it holds an unread frame
+	std::atomic<uint8_t> m_Middle;
+	uint8_t m_Back;
+	uint8_t m_Front;
+	bool m_FrontValid;
+
+	std::mutex m_FrontMutex;
+};
+
+#endif // !FRAMEHANDOFF_H
@@ -0,0 +1,69 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "FramePacer.h"
+
+#include <algorithm>
+
+#ifndef SEC_TO_NSEC
+#define SEC_TO_NSEC 1000000000ULL
+#endif
+
+FramePacer::FramePacer() : m_MinInterval(0), m_Adaptive(false), m_Budget(0), m_Start(0), m_Next(0)
+{
+}
+
+void FramePacer::Configure(double max_rate, bool adaptive, uint64_t budget_ns)
+{
+	m_MinInterval = max_rate > 0.0 ? (uint64_t)(SEC_TO_NSEC / max_rate) : 0;
+	m_Adaptive = adaptive;
+	m_Budget = budget_ns;
+}
+
+bool FramePacer::Ready(uint64_t now) const
+{
+	return now >= m_Next;
+}
+
+void FramePacer::Begin(uint64_t now)
+{
+	m_Start = now;
+	// From the previous slot, frames arriving a little after it would slow the rate down.
+	// Once a whole interval behind, after a gap in the frames, it starts over from now.
+	if (m_Next + m_MinInterval > now)
+		m_Next += m_MinInterval;
+	else
+		m_Next = now + m_MinInterval;
+}
+
+void FramePacer::End(uint64_t now, uint64_t frame_interval)
+{
+	uint64_t duration = now - m_Start;
+	if (!m_Adaptive || frame_interval == 0 || duration <= frame_interval)
+		return;
+
+	// Frames that arrived while matching were already dropped, drop as many again so an
+	// overloaded matcher keeps at most about half a core busy
+	uint64_t dropped = (duration + frame_interval - 1) / frame_interval;
+	m_Next = std::max(m_Next, now + dropped * frame_interval);
+}
+
+uint64_t FramePacer::Deadline() const
+{
+	return m_Budget > 0 ? m_Start + m_Budget : 0;
+}
@@ -0,0 +1,54 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+#include <cstdint>
+
+// Decides which frames the matcher analyzes, so a heavy filter can't take more CPU than its
+// settings allow. Times are os_gettime_ns nanoseconds.
+class FramePacer {
+public:
+	FramePacer();
+
+	// Rate limits analysis starts, zero analyzes every frame. Adaptive pacing drops as many
+	// frames after an analysis as arrived during it when it took longer than a frame. Budget
+	// is the time a frame may take before the remaining templates are skipped and running
+	// searches stop between scales and candidates, zero for none.
+	void Configure(double max_rate, bool adaptive, uint64_t budget_ns);
+
+	// Frame arriving now should be analyzed
+	bool Ready(uint64_t now) const;
+
+	void Begin(uint64_t now);
+	void End(uint64_t now, uint64_t frame_interval);
+
+	// Time the current analysis has to finish by, zero without a budget
+	uint64_t Deadline() const;
+
+private:
+	uint64_t m_MinInterval;
+	bool m_Adaptive;
+	uint64_t m_Budget;
+
+	uint64_t m_Start;
+	uint64_t m_Next;
+};
+
+#endif // !FRAMEPACER_H
@@ -0,0 +1,220 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "MatchPipeline.h"
+
+#include <util/platform.h>
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <functional>
+
+MatchPipeline::MatchPipeline(ThreadPool &pool, PipelineStats &stats)
+	: m_Pool(pool),
+	  m_Stats(stats),
+	  m_CopyRows(FrameHandoff::ALL_ROWS),
+	  m_Started(0)
+{
+}
+
+bool MatchPipeline::Analyze(const obs_source_frame *frame, FrameRows copied,
+			    const std::shared_ptr<const TemplateList> &templates,
+			    const Settings &settings)
+{
+	if (!m_Ingest || m_Ingest->format() != frame->format)
+		m_Ingest = lvk::FrameIngest::Select(frame->format);
+
+	if (templates->empty() || !m_Ingest)
+		return false;
+
+	// The frame is ingested once and shared by all of the templates
+	cv::Size largest(0, 0);
+	cv::Size smallest(INT_MAX, INT_MAX);
+	int pyramid_levels = 0;
+	for (const auto &matcher : *templates) {
+		largest.width = std::max(largest.width, matcher->Size().width);
+		largest.height = std::max(largest.height, matcher->Size().height);
+		smallest.width = std::min(smallest.width, matcher->Size().width);
+		smallest.height = std::min(smallest.height, matcher->Size().height);
+		pyramid_levels = std::max(pyramid_levels, matcher->PyramidLevels());
+	}
+
+	// NOTE: The region upload respects the plane linesizes of the copied frame
+	cv::Rect bounds(0, 0, (int)frame->width, (int)frame->height);
+	// Clamped here rather than by the upload, so locations and tracking use the same region
+	cv::Rect roi = settings.roi & bounds;
+	if (!roi.empty() && (roi.width >= largest.width && roi.height >= largest.height)) {
+		// Only the region of interest is copied out of the frame
+		bounds = roi;
+	}
+
+	// Later frames are copied for these rows, this one was copied for the rows wanted before
+	m_CopyRows = FrameRows{(uint32_t)bounds.y, (uint32_t)bounds.height};
+	if (bounds.y < (int)copied.first || bounds.br().y > (int)(copied.first + copied.count)) {
+		m_Stats.FrameDropped();
+		return false;
+	}
+
+	// Frames the scheduling policy doesn't want are dropped without any work
+	m_Pacer.Configure(settings.analysis_rate, settings.adaptive_rate, settings.frame_budget);
+	uint64_t start = os_gettime_ns();
+	if (!m_Pacer.Ready(start)) {
+		m_Stats.FrameDropped();
+		return false;
+	}
+	m_Pacer.Begin(start);
+	m_Started = start;
+	m_Stats.FrameProcessed();
+
+	// While every template is tracked only their windows need to be copied
+	cv::Rect windows;
+	bool all_tracked = true;
+	for (const auto &matcher : *templates) {
+		if (matcher->TrackingWindow().empty()) {
+			all_tracked = false;
+			break;
+		}
+		windows |= matcher->TrackingWindow();
+	}
+	cv::Rect region = bounds;
+	// Windows were clamped to the bounds of an earlier frame, which may have been larger
+	if (all_tracked && (windows & bounds) == windows) {
+		region = windows;
+		// Tracking windows are always searched at full resolution
+		pyramid_levels = 0;
+	}
+	m_Region = region;
+
+	// Some template was left unfinished by the frame budget
+	std::atomic<bool> over_budget(false);
+
+	// Gray, the luma plane is used as is so chroma is never uploaded
+	m_Ingest->upload_luma(frame, m_Gray, region);
+	uint64_t stage_start = os_gettime_ns();
+	m_Stats.Record(PipelineStats::STAGE_INGEST, stage_start - start);
+
+	{
+		cv::Mat gray = m_Gray.getMat(cv::ACCESS_READ);
+
+		// Same image matches the same, so on an unchanged region templates keep their
+		// previous results once matching them again wouldn't change anything
+		bool changed = true;
+		if (settings.skip_unchanged) {
+			// Cells of half the smallest template, so a change of a whole template
+			// moves at least one cell as much as its pixels changed
+			changed = m_ChangeDetector.Changed(gray, region, smallest / 2,
+							   settings.change_threshold);
+			uint64_t now = os_gettime_ns();
+			m_Stats.Record(PipelineStats::STAGE_CHANGE, now - stage_start);
+			stage_start = now;
+		} else {
+			m_ChangeDetector.Reset();
+		}
+
+		if (templates != m_Templates) {
+			m_Templates = templates;
+			m_Matches.assign(templates->size(), MatchResult());
+			m_Search.assign(templates->size(), false);
+			changed = true;
+		}
+
+		// Debouncing still has to count the frames, and scales searched in turn have to
+		// get theirs on the unchanged image
+		bool searching = false;
+		for (size_t i = 0; i < templates->size(); i++) {
+			if (changed)
+				(*templates)[i]->ImageChanged();
+			m_Search[i] = changed || !(*templates)[i]->Settled();
+			searching = searching || m_Search[i];
+		}
+
+		if (searching) {
+			// Downscaled frames for the coarse search, level 0 is the frame itself
+			cv::buildPyramid(gray, m_Pyramid, pyramid_levels);
+			uint64_t now = os_gettime_ns();
+			m_Stats.Record(PipelineStats::STAGE_PYRAMID, now - stage_start);
+			stage_start = now;
+			// Templates are independent of each other, so they are matched in parallel.
+			// Templates not started before the budget runs out, and searches it cuts
+			// short before finding anything, are left unfinished.
+			uint64_t deadline = m_Pacer.Deadline();
+			// Score maps are only drawn by the debug view
+			for (const auto &matcher : *templates)
+				matcher->SetScoreMap(settings.score_maps);
+			auto match = [&](int i) {
+				if (!m_Search[i])
+					return;
+				if (deadline != 0 && os_gettime_ns() > deadline) {
+					m_Matches[i].unfinished = true;
+					over_budget = true;
+					return;
+				}
+				m_Matches[i] =
+					(*templates)[i]->Match(m_Pyramid, region.tl(), deadline);
+				if (m_Matches[i].unfinished)
+					over_budget = true;
+			};
+			// By reference, a std::function holding the lambda itself would allocate
+			m_Pool.ParallelFor((int)templates->size(), std::ref(match));
+			m_Stats.Record(PipelineStats::STAGE_MATCH, os_gettime_ns() - stage_start);
+
+			// Unfinished templates must be matched again even if nothing changes
+			if (over_budget)
+				m_ChangeDetector.Reset();
+			for (size_t i = 0; i < templates->size(); i++) {
+				if (m_Search[i] && !m_Matches[i].unfinished)
+					(*templates)[i]->Track(m_Matches[i], region.tl(), bounds);
+			}
+
+			// NOTE: Level 0 maps the gray frame, which must be unmapped before it is
+			// drawn on. The other levels keep their buffers for the next frame.
+			m_Pyramid[0].release();
+		} else {
+			m_Stats.FrameUnchanged();
+		}
+	}
+
+	m_Pacer.End(os_gettime_ns(), settings.frame_interval);
+	return true;
+}
+
+FrameRows MatchPipeline::CopyRows() const
+{
+	return m_CopyRows;
+}
+
+const std::vector<MatchResult> &MatchPipeline::Matches() const
+{
+	return m_Matches;
+}
+
+cv::Rect MatchPipeline::Region() const
+{
+	return m_Region;
+}
+
+const cv::UMat &MatchPipeline::Gray() const
+{
+	return m_Gray;
+}
+
+uint64_t MatchPipeline::Started() const
+{
+	return m_Started;
+}
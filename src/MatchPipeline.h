@@ -0,0 +1,106 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef MATCHPIPELINE_H
+#define MATCHPIPELINE_H
+
+#ifdef __cplusplus
+#undef NO
+#undef YES
+#include <opencv2/opencv.hpp>
+#include "vendor/LiveVisionKit/FrameIngest.hpp"
+#endif
+
+#include "ChangeDetector.h"
+#include "FrameHandoff.h"
+#include "FramePacer.h"
+#include "PipelineStats.h"
+#include "TemplateMatcher.h"
+#include "ThreadPool.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Analysis stage of the match job, from the copied frame to the match results of every
+// template. Reacting to the results is left to the caller. The buffers and the state carried
+// from frame to frame are kept, so once warmed up a steady stream of frames is analyzed
+// without allocating.
+class MatchPipeline {
+public:
+	struct Settings {
+		// Region of interest in frame coordinates, empty searches the whole frame
+		cv::Rect roi;
+		bool skip_unchanged;
+		double change_threshold;
+		// Score maps of the templates are kept for the debug view
+		bool score_maps;
+		// Frame pacing, see FramePacer::Configure
+		double analysis_rate;
+		bool adaptive_rate;
+		uint64_t frame_budget;
+		// Nanoseconds between the frames of the source
+		uint64_t frame_interval;
+	};
+
+	MatchPipeline(ThreadPool &pool, PipelineStats &stats);
+
+	MatchPipeline(const MatchPipeline &) = delete;
+	MatchPipeline &operator=(const MatchPipeline &) = delete;
+
+	// Matches the templates in the frame, of which the copied rows are valid. Returns false if
+	// the frame was dropped, by the pacer or because it lacks rows now needed.
+	bool Analyze(const obs_source_frame *frame, FrameRows copied,
+		     const std::shared_ptr<const TemplateList> &templates,
+		     const Settings &settings);
+
+	// Rows later frames need to be copied for
+	FrameRows CopyRows() const;
+
+	// Results of the last analyzed frame, one for each template of its list. Locations are
+	// relative to the searched region.
+	const std::vector<MatchResult> &Matches() const;
+	cv::Rect Region() const;
+	// Searched region of the last analyzed frame in gray
+	const cv::UMat &Gray() const;
+	// Time the last analysis started (os_gettime_ns)
+	uint64_t Started() const;
+
+private:
+	ThreadPool &m_Pool;
+	PipelineStats &m_Stats;
+
+	// LiveVisionKit, OBS Frame -> OpenCV frame
+	std::unique_ptr<lvk::FrameIngest> m_Ingest;
+
+	// Working buffers, only reallocated when the size of the searched region changes
+	cv::UMat m_Gray;
+	std::vector<cv::Mat> m_Pyramid;
+
+	ChangeDetector m_ChangeDetector;
+	FramePacer m_Pacer;
+	std::shared_ptr<const TemplateList> m_Templates;
+	std::vector<MatchResult> m_Matches;
+	// Templates searched on the current frame
+	std::vector<char> m_Search;
+	FrameRows m_CopyRows;
+	cv::Rect m_Region;
+	uint64_t m_Started;
+};
+
+#endif // !MATCHPIPELINE_H
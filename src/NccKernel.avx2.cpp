@@ -0,0 +1,74 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+// Compiled with AVX2 enabled, only called when the CPU supports it
+#include "NccKernelImpl.h"
+
+#include <immintrin.h>
+
+namespace {
+
+inline int64_t horizontal_sum(__m256i v)
+{
+	__m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+	s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(s);
+}
+
+struct Avx2Window {
+	static inline NccSums Sums(const uint8_t *image, size_t step, const NccTemplate &templ)
+	{
+		const __m256i ones = _mm256_set1_epi16(1);
+		__m256i sum = _mm256_setzero_si256();
+		__m256i sqsum = _mm256_setzero_si256();
+		__m256i dot = _mm256_setzero_si256();
+		NccSums sums = {0, 0, 0};
+
+		for (int y = 0; y < templ.height; y++) {
+			const uint8_t *row = image + y * step;
+			const uint8_t *templ_row = templ.data + y * templ.step;
+
+			int x = 0;
+			for (; x + 16 <= templ.width; x += 16) {
+				__m256i pixels = _mm256_cvtepu8_epi16(
+					_mm_loadu_si128((const __m128i *)(row + x)));
+				__m256i templ_pixels = _mm256_cvtepu8_epi16(
+					_mm_loadu_si128((const __m128i *)(templ_row + x)));
+				sum = _mm256_add_epi32(sum, _mm256_madd_epi16(pixels, ones));
+				sqsum = _mm256_add_epi32(sqsum, _mm256_madd_epi16(pixels, pixels));
+				dot = _mm256_add_epi32(dot,
+						       _mm256_madd_epi16(pixels, templ_pixels));
+			}
+			ncc_sums_scalar(row, templ_row, x, templ.width, sums);
+		}
+
+		sums.sum += horizontal_sum(sum);
+		sums.sqsum += horizontal_sum(sqsum);
+		sums.dot += horizontal_sum(dot);
+		return sums;
+	}
+};
+
+} // namespace
+
+void ncc_match_avx2(const uint8_t *image, size_t step, int width, int height,
+		    const NccTemplate &templ, double stop_score, NccPeak &peak)
+{
+	ncc_scan<Avx2Window>(image, step, width, height, templ, stop_score, peak);
+}
@@ -0,0 +1,168 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "NccKernel.h"
+
+#include <obs-module.h>
+
+namespace {
+
+struct ScalarWindow {
+	static inline NccSums Sums(const uint8_t *image, size_t step, const NccTemplate &templ)
+	{
+		NccSums sums = {0, 0, 0};
+		for (int y = 0; y < templ.height; y++) {
+			const uint8_t *templ_row = templ.data + y * templ.step;
+			ncc_sums_scalar(image + y * step, templ_row, 0, templ.width, sums);
+		}
+		return sums;
+	}
+};
+
+struct KernelCandidate {
+	const char *name;
+	NccMatchFunction match;
+	int cpu_feature;
+};
+
+// Picked by the self test, nullptr until it has passed
+NccMatchFunction active_kernel = nullptr;
+
+NccTemplate describe_template(const cv::Mat &templ)
+{
+	NccTemplate info;
+	info.data = templ.data;
+	info.step = templ.step;
+	info.width = templ.cols;
+	info.height = templ.rows;
+	info.sum = (int64_t)cv::sum(templ)[0];
+	info.variance = (int64_t)templ.total() * (int64_t)templ.dot(templ) - info.sum * info.sum;
+	return info;
+}
+
+// Peak of the OpenCV scores the kernels are checked against
+NccPeak reference_peak(const cv::Mat &image, const cv::Mat &templ)
+{
+	cv::Mat result;
+	cv::matchTemplate(image, templ, result, cv::TM_CCOEFF_NORMED);
+
+	double score;
+	cv::Point location;
+	cv::minMaxLoc(result, nullptr, &score, nullptr, &location);
+	return {score, location.x, location.y};
+}
+
+bool test_kernel(const KernelCandidate &candidate)
+{
+	// Odd sizes leave tails after the vector loops, the last case is a single position
+	const cv::Size image_sizes[] = {{160, 120}, {97, 61}, {64, 48}, {33, 17}};
+	const cv::Size templ_sizes[] = {{37, 29}, {40, 40}, {7, 5}, {33, 17}};
+
+	cv::RNG rng(0x4e4343);
+	for (size_t i = 0; i < sizeof(image_sizes) / sizeof(image_sizes[0]); i++) {
+		cv::Mat image(image_sizes[i], CV_8UC1);
+		rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+
+		// Template is cut from the image with some noise so there is a single clear peak
+		cv::Point origin(rng.uniform(0, image.cols - templ_sizes[i].width + 1),
+				 rng.uniform(0, image.rows - templ_sizes[i].height + 1));
+		cv::Mat templ = image(cv::Rect(origin, templ_sizes[i])).clone();
+		cv::Mat noise(templ.size(), CV_8UC1);
+		rng.fill(noise, cv::RNG::UNIFORM, 0, 16);
+		cv::add(templ, noise, templ);
+
+		NccTemplate info = describe_template(templ);
+
+		NccPeak expected = reference_peak(image, templ);
+		NccPeak peak;
+		candidate.match(image.data, image.step, image.cols, image.rows, info, 2.0, peak);
+		if (std::abs(peak.score - expected.score) > 1e-3 || peak.x != expected.x ||
+		    peak.y != expected.y) {
+			blog(LOG_WARNING,
+			     "NCC kernel %s: peak %.5f at %d,%d but OpenCV has %.5f at %d,%d",
+			     candidate.name, peak.score, peak.x, peak.y, expected.score, expected.x,
+			     expected.y);
+			return false;
+		}
+
+		// Search has to stop at the first position over the stop score
+		double stop_score = expected.score / 2;
+		candidate.match(image.data, image.step, image.cols, image.rows, info, stop_score,
+				peak);
+		if (peak.score < stop_score) {
+			blog(LOG_WARNING, "NCC kernel %s: early exit returned %.5f under %.5f",
+			     candidate.name, peak.score, stop_score);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+} // namespace
+
+void ncc_match_scalar(const uint8_t *image, size_t step, int width, int height,
+		      const NccTemplate &templ, double stop_score, NccPeak &peak)
+{
+	ncc_scan<ScalarWindow>(image, step, width, height, templ, stop_score, peak);
+}
+
+NccKernel::NccKernel(const cv::Mat &templ)
+	: m_Template(templ),
+	  m_Info(describe_template(templ))
+{
+}
+
+bool NccKernel::Usable() const
+{
+	return active_kernel != nullptr && m_Template.type() == CV_8UC1 &&
+	       m_Template.total() <= NCC_MAX_AREA;
+}
+
+NccPeak NccKernel::Match(const cv::Mat &image, double stop_score) const
+{
+	NccPeak peak;
+	active_kernel(image.data, image.step, image.cols, image.rows, m_Info, stop_score, peak);
+	return peak;
+}
+
+bool NccKernel::SelfTest()
+{
+	// Fastest first
+	const KernelCandidate candidates[] = {
+#ifdef NCC_KERNEL_X86
+		{"AVX2", ncc_match_avx2, CV_CPU_AVX2},
+		{"SSE4.1", ncc_match_sse4, CV_CPU_SSE4_1},
+#endif
+		{"scalar", ncc_match_scalar, 0},
+	};
+
+	for (const KernelCandidate &candidate : candidates) {
+		if (candidate.cpu_feature != 0 && !cv::checkHardwareSupport(candidate.cpu_feature))
+			continue;
+
+		if (test_kernel(candidate)) {
+			active_kernel = candidate.match;
+			blog(LOG_INFO, "NCC kernel %s agrees with OpenCV", candidate.name);
+			return true;
+		}
+	}
+
+	blog(LOG_WARNING, "no NCC kernel agrees with OpenCV, using cv::matchTemplate only");
+	return false;
+}
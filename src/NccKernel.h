@@ -0,0 +1,51 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef NCCKERNEL_H
+#define NCCKERNEL_H
+
+#include "NccKernelImpl.h"
+
+#ifdef __cplusplus
+#undef NO
+#undef YES
+#include <opencv2/opencv.hpp>
+#endif
+
+// Direct TM_CCOEFF_NORMED search for small templates, with the fastest kernel this CPU
+// supports. Cheaper than cv::matchTemplate when there are few positions to score, since no
+// result image is written and the search can stop at the first detection.
+class NccKernel {
+public:
+	explicit NccKernel(const cv::Mat &templ);
+
+	// Kernel passed the self test and the template is small enough for it
+	bool Usable() const;
+
+	NccPeak Match(const cv::Mat &image, double stop_score) const;
+
+	// Compares the kernels against cv::matchTemplate and picks the fastest one that agrees,
+	// kernels stay unusable if none do. Run once when the module loads.
+	static bool SelfTest();
+
+private:
+	cv::Mat m_Template;
+	NccTemplate m_Info;
+};
+
+#endif // !NCCKERNEL_H
@@ -0,0 +1,72 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+// Compiled with SSE4.1 enabled, only called when the CPU supports it
+#include "NccKernelImpl.h"
+
+#include <smmintrin.h>
+
+namespace {
+
+inline int64_t horizontal_sum(__m128i v)
+{
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(v);
+}
+
+struct Sse4Window {
+	static inline NccSums Sums(const uint8_t *image, size_t step, const NccTemplate &templ)
+	{
+		const __m128i ones = _mm_set1_epi16(1);
+		__m128i sum = _mm_setzero_si128();
+		__m128i sqsum = _mm_setzero_si128();
+		__m128i dot = _mm_setzero_si128();
+		NccSums sums = {0, 0, 0};
+
+		for (int y = 0; y < templ.height; y++) {
+			const uint8_t *row = image + y * step;
+			const uint8_t *templ_row = templ.data + y * templ.step;
+
+			int x = 0;
+			for (; x + 8 <= templ.width; x += 8) {
+				__m128i pixels = _mm_cvtepu8_epi16(
+					_mm_loadl_epi64((const __m128i *)(row + x)));
+				__m128i templ_pixels = _mm_cvtepu8_epi16(
+					_mm_loadl_epi64((const __m128i *)(templ_row + x)));
+				sum = _mm_add_epi32(sum, _mm_madd_epi16(pixels, ones));
+				sqsum = _mm_add_epi32(sqsum, _mm_madd_epi16(pixels, pixels));
+				dot = _mm_add_epi32(dot, _mm_madd_epi16(pixels, templ_pixels));
+			}
+			ncc_sums_scalar(row, templ_row, x, templ.width, sums);
+		}
+
+		sums.sum += horizontal_sum(sum);
+		sums.sqsum += horizontal_sum(sqsum);
+		sums.dot += horizontal_sum(dot);
+		return sums;
+	}
+};
+
+} // namespace
+
+void ncc_match_sse4(const uint8_t *image, size_t step, int width, int height,
+		    const NccTemplate &templ, double stop_score, NccPeak &peak)
+{
+	ncc_scan<Sse4Window>(image, step, width, height, templ, stop_score, peak);
+}
@@ -0,0 +1,121 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef NCCKERNELIMPL_H
+#define NCCKERNELIMPL_H
+
+// Plain C++ part of the NCC kernels shared by the instruction set specific files. Every
+// function here has internal linkage so each file gets its own copy compiled with its own
+// instruction set.
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Largest template area the kernels support, sums of products of 8-bit pixels over it still
+// fit the 32-bit vector accumulators
+#define NCC_MAX_AREA 16384
+
+// 8-bit template with the sums the score needs precomputed
+struct NccTemplate {
+	const uint8_t *data;
+	size_t step;
+	int width, height;
+
+	int64_t sum;
+	// Pixel count times the sum of squares minus the square of the sum
+	int64_t variance;
+};
+
+struct NccPeak {
+	double score;
+	int x, y;
+};
+
+// Scans the template over the 8-bit image keeping the best normalized correlation coefficient,
+// stopping at the first position that scores stop_score or more
+typedef void (*NccMatchFunction)(const uint8_t *image, size_t step, int width, int height,
+				 const NccTemplate &templ, double stop_score, NccPeak &peak);
+
+// NOTE: The kernels are plain C++ so the instruction set specific files don't instantiate
+// any OpenCV inlines with wider instructions than the CPU may support.
+void ncc_match_scalar(const uint8_t *image, size_t step, int width, int height,
+		      const NccTemplate &templ, double stop_score, NccPeak &peak);
+#ifdef NCC_KERNEL_X86
+void ncc_match_sse4(const uint8_t *image, size_t step, int width, int height,
+		    const NccTemplate &templ, double stop_score, NccPeak &peak);
+void ncc_match_avx2(const uint8_t *image, size_t step, int width, int height,
+		    const NccTemplate &templ, double stop_score, NccPeak &peak);
+#endif
+
+struct NccSums {
+	int64_t sum;
+	int64_t sqsum;
+	int64_t dot;
+};
+
+static inline double ncc_score(const NccSums &sums, const NccTemplate &templ)
+{
+	const int64_t count = (int64_t)templ.width * templ.height;
+
+	// Flat windows score zero like in OpenCV
+	int64_t variance = count * sums.sqsum - sums.sum * sums.sum;
+	if (variance <= 0 || templ.variance <= 0)
+		return 0.0;
+
+	double numerator = (double)(count * sums.dot - sums.sum * templ.sum);
+	return numerator / std::sqrt((double)variance * (double)templ.variance);
+}
+
+// Window::Sums sums one template position
+template<typename Window>
+static inline void ncc_scan(const uint8_t *image, size_t step, int width, int height,
+			    const NccTemplate &templ, double stop_score, NccPeak &peak)
+{
+	peak.score = -2.0;
+	peak.x = 0;
+	peak.y = 0;
+
+	for (int y = 0; y + templ.height <= height; y++) {
+		const uint8_t *row = image + y * step;
+		for (int x = 0; x + templ.width <= width; x++) {
+			double score = ncc_score(Window::Sums(row + x, step, templ), templ);
+			if (score > peak.score) {
+				peak.score = score;
+				peak.x = x;
+				peak.y = y;
+			}
+			if (score >= stop_score)
+				return;
+		}
+	}
+}
+
+// Tail of a row the vector loop didn't cover
+static inline void ncc_sums_scalar(const uint8_t *image, const uint8_t *templ, int from, int to,
+				   NccSums &sums)
+{
+	for (int x = from; x < to; x++) {
+		int pixel = image[x];
+		sums.sum += pixel;
+		sums.sqsum += pixel * pixel;
+		sums.dot += pixel * templ[x];
+	}
+}
+
+#endif // !NCCKERNELIMPL_H
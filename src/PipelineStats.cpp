@@ -0,0 +1,161 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "PipelineStats.h"
+
+#include <algorithm>
+#include <cstdio>
+
+LatencyHistogram::LatencyHistogram() : m_Count(0), m_Sum(0), m_Max(0)
+{
+	for (auto &bucket : m_Buckets)
+		bucket.store(0, std::memory_order_relaxed);
+}
+
+int LatencyHistogram::bucket(uint64_t us)
+{
+	if (us < SUB_BUCKETS)
+		return (int)us;
+
+	int exponent = 0;
+	while ((us >> (exponent + 1)) != 0)
+		exponent++;
+
+	// Two bits below the leading one pick the sub-bucket
+	int sub = (int)(us >> (exponent - 2)) & (SUB_BUCKETS - 1);
+	return std::min((exponent - 1) * SUB_BUCKETS + sub, BUCKETS - 1);
+}
+
+double LatencyHistogram::value(int bucket)
+{
+	if (bucket < SUB_BUCKETS)
+		return bucket + 0.5;
+
+	int exponent = bucket / SUB_BUCKETS + 1;
+	int sub = bucket % SUB_BUCKETS;
+	double width = (double)(1ULL << (exponent - 2));
+	return (SUB_BUCKETS + sub) * width + width / 2.0;
+}
+
+void LatencyHistogram::Record(uint64_t ns)
+{
+	m_Buckets[bucket(ns / 1000)].fetch_add(1, std::memory_order_relaxed);
+	m_Count.fetch_add(1, std::memory_order_relaxed);
+	m_Sum.fetch_add(ns, std::memory_order_relaxed);
+
+	uint64_t max = m_Max.load(std::memory_order_relaxed);
+	while (ns > max && !m_Max.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+	}
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::Read() const
+{
+	Snapshot s = {0, 0.0, 0.0, 0.0, 0.0};
+
+	uint64_t counts[BUCKETS];
+	for (int i = 0; i < BUCKETS; i++) {
+		counts[i] = m_Buckets[i].load(std::memory_order_relaxed);
+		s.count += counts[i];
+	}
+	if (s.count == 0)
+		return s;
+
+	s.mean = (double)m_Sum.load(std::memory_order_relaxed) / (double)m_Count.load() / 1000.0;
+	s.max = (double)m_Max.load(std::memory_order_relaxed) / 1000.0;
+
+	auto percentile = [&](double p) {
+		uint64_t rank = (uint64_t)(p * (double)(s.count - 1));
+		uint64_t seen = 0;
+		for (int i = 0; i < BUCKETS; i++) {
+			seen += counts[i];
+			if (seen > rank)
+				return std::min(value(i), s.max);
+		}
+		return s.max;
+	};
+	s.p50 = percentile(0.5);
+	s.p99 = percentile(0.99);
+	return s;
+}
+
+void PipelineStats::Record(Stage stage, uint64_t ns)
+{
+	m_Stages[stage].Record(ns);
+}
+
+void PipelineStats::FrameSeen()
+{
+	m_Seen.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PipelineStats::FrameDropped()
+{
+	m_Dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PipelineStats::FrameProcessed()
+{
+	m_Processed.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PipelineStats::FrameUnchanged()
+{
+	m_Unchanged.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PipelineStats::MatchSuppressed()
+{
+	m_Suppressed.fetch_add(1, std::memory_order_relaxed);
+}
+
+LatencyHistogram::Snapshot PipelineStats::Read(Stage stage) const
+{
+	return m_Stages[stage].Read();
+}
+
+std::string PipelineStats::Summary() const
+{
+	static const char *const names[STAGE_COUNT] = {
+		"ingest", "change", "pyramid", "match", "analysis", "playback", "latency",
+	};
+
+	char line[160];
+	snprintf(line, sizeof(line),
+		 "frames: %llu seen, %llu processed, %llu unchanged, %llu dropped, "
+		 "%llu suppressed\n",
+		 (unsigned long long)m_Seen.load(), (unsigned long long)m_Processed.load(),
+		 (unsigned long long)m_Unchanged.load(), (unsigned long long)m_Dropped.load(),
+		 (unsigned long long)m_Suppressed.load());
+	std::string summary = line;
+
+	// Milliseconds
+	for (int i = 0; i < STAGE_COUNT; i++) {
+		LatencyHistogram::Snapshot s = m_Stages[i].Read();
+		if (s.count == 0)
+			continue;
+		snprintf(line, sizeof(line),
+			 "%-8s n=%llu mean %.2f p50 %.2f p99 %.2f max %.2f ms\n", names[i],
+			 (unsigned long long)s.count, s.mean / 1000.0, s.p50 / 1000.0,
+			 s.p99 / 1000.0, s.max / 1000.0);
+		summary += line;
+	}
+
+	// No trailing newline, blog and the properties add their own
+	summary.pop_back();
+	return summary;
+}
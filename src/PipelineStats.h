@@ -0,0 +1,113 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef PIPELINESTATS_H
+#define PIPELINESTATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Histogram of nanosecond durations that any number of threads may record into without
+// locking. Buckets are powers of two of microseconds split into four, so percentiles are
+// within about 20% of the true value.
+class LatencyHistogram {
+public:
+	struct Snapshot {
+		uint64_t count;
+		// Microseconds
+		double mean;
+		double p50;
+		double p99;
+		double max;
+	};
+
+	LatencyHistogram();
+
+	LatencyHistogram(const LatencyHistogram &) = delete;
+	LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+	void Record(uint64_t ns);
+
+	// Counts recorded meanwhile may or may not be included
+	Snapshot Read() const;
+
+private:
+	static constexpr int SUB_BUCKETS = 4;
+	static constexpr int BUCKETS = 40 * SUB_BUCKETS;
+
+	static int bucket(uint64_t us);
+	// Middle of the bucket in microseconds
+	static double value(int bucket);
+
+	std::atomic<uint64_t> m_Buckets[BUCKETS];
+	std::atomic<uint64_t> m_Count;
+	std::atomic<uint64_t> m_Sum;
+	std::atomic<uint64_t> m_Max;
+};
+
+// Timings and frame counters of one filter, written by the video callback, the match jobs
+// and the beep scheduler and read by the properties and the periodic log summaries
+class PipelineStats {
+public:
+	enum Stage {
+		// Luma plane copied out of the frame
+		STAGE_INGEST,
+		// Signature of the region compared to the previous frame
+		STAGE_CHANGE,
+		STAGE_PYRAMID,
+		// Correlation and peak search of every template
+		STAGE_MATCH,
+		// Whole analysis of a frame, from the pacer letting it through to the decision
+		STAGE_ANALYSIS,
+		// How late the scheduler submitted a sequence to the audio output
+		STAGE_PLAYBACK,
+		// Source frame timestamp to the audio submission of the detection's sequence
+		STAGE_LATENCY,
+		STAGE_COUNT
+	};
+
+	void Record(Stage stage, uint64_t ns);
+
+	// Frames the video callback handed to the matcher
+	void FrameSeen();
+	// Frames replaced before a match job took them or dropped by the pacer
+	void FrameDropped();
+	// Frames analyzed, including the ones an unchanged region let skip matching
+	void FrameProcessed();
+	void FrameUnchanged();
+	// Detections held back by the cooldown
+	void MatchSuppressed();
+
+	// Durations recorded for the stage so far
+	LatencyHistogram::Snapshot Read(Stage stage) const;
+
+	// Multi-line human readable summary
+	std::string Summary() const;
+
+private:
+	LatencyHistogram m_Stages[STAGE_COUNT];
+
+	std::atomic<uint64_t> m_Seen{0};
+	std::atomic<uint64_t> m_Dropped{0};
+	std::atomic<uint64_t> m_Processed{0};
+	std::atomic<uint64_t> m_Unchanged{0};
+	std::atomic<uint64_t> m_Suppressed{0};
+};
+
+#endif // !PIPELINESTATS_H
@@ -0,0 +1,81 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "ScoreHistory.h"
+
+#include <util/platform.h>
+
+#include <algorithm>
+#include <cstdio>
+
+ScoreHistory::ScoreHistory(size_t frames, size_t slots)
+	: m_Slots(slots), m_Times(frames, 0), m_Samples(frames * slots, Sample()), m_Count(0)
+{
+}
+
+size_t ScoreHistory::Slots() const
+{
+	return m_Slots;
+}
+
+void ScoreHistory::Add(uint64_t frame_time, const Sample *samples)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	size_t frame = (size_t)(m_Count++ % m_Times.size());
+	m_Times[frame] = frame_time;
+	std::copy(samples, samples + m_Slots, m_Samples.begin() + frame * m_Slots);
+}
+
+bool ScoreHistory::WriteCsv(const std::string &path) const
+{
+	// Writing the file happens outside the lock, on a snapshot of the ring
+	std::vector<uint64_t> times;
+	std::vector<Sample> samples;
+	uint64_t count;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		times = m_Times;
+		samples = m_Samples;
+		count = m_Count;
+	}
+
+	FILE *file = os_fopen(path.c_str(), "w");
+	if (file == nullptr)
+		return false;
+
+	fprintf(file, "frame,frame_time");
+	for (size_t slot = 0; slot < m_Slots; slot++)
+		fprintf(file, ",score_%zu,x_%zu,y_%zu", slot + 1, slot + 1, slot + 1);
+	fprintf(file, "\n");
+
+	uint64_t first = count > times.size() ? count - times.size() : 0;
+	for (uint64_t i = first; i < count; i++) {
+		size_t frame = (size_t)(i % times.size());
+		fprintf(file, "%llu,%llu", (unsigned long long)i, (unsigned long long)times[frame]);
+		for (size_t slot = 0; slot < m_Slots; slot++) {
+			const Sample &s = samples[frame * m_Slots + slot];
+			if (s.missing)
+				fprintf(file, ",,,");
+			else
+				fprintf(file, ",%.4f,%d,%d", s.score, s.x, s.y);
+		}
+		fprintf(file, "\n");
+	}
+
+	return fclose(file) == 0;
+}
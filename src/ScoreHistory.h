@@ -0,0 +1,60 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef SCOREHISTORY_H
+#define SCOREHISTORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Best score and location of every template slot on the latest frames, for tuning thresholds
+// after the fact. The memory is allocated once, recording a frame only copies into it.
+class ScoreHistory {
+public:
+	struct Sample {
+		float score;
+		// Top left corner of the best match in the frame
+		int x, y;
+		// Slot wasn't matched on the frame
+		bool missing;
+	};
+
+	ScoreHistory(size_t frames, size_t slots);
+
+	size_t Slots() const;
+
+	// Copies Slots() samples, time is the source timestamp of the frame
+	void Add(uint64_t frame_time, const Sample *samples);
+
+	// Oldest frame first, missing samples as empty fields. Returns false if the file couldn't
+	// be written.
+	bool WriteCsv(const std::string &path) const;
+
+private:
+	size_t m_Slots;
+	std::vector<uint64_t> m_Times;
+	std::vector<Sample> m_Samples;
+	uint64_t m_Count;
+
+	mutable std::mutex m_Mutex;
+};
+
+#endif // !SCOREHISTORY_H
@@ -0,0 +1,592 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "TemplateMatcher.h"
+
+#include <util/platform.h>
+
+#include <bitset>
+#include <cmath>
+
+// Coarse candidates refined at full resolution
+#define PYRAMID_CANDIDATES 4
+// Templates aren't downscaled below this, too few pixels left to tell matches apart
+#define PYRAMID_MIN_SIZE 8
+// Positions times template area up to which the direct kernel beats the FFT
+#define DIRECT_MAX_WORK (1 << 27)
+// Width of the kept score maps at most
+#define SCORE_MAP_WIDTH 160
+// Ratio between neighbouring template scales, about what the score tolerates either way
+#define SCALE_STEP 1.1
+
+// Scores of every method turned so that higher is more similar and 1 is a perfect match
+static void to_similarity(cv::Mat &result, int method, bool masked)
+{
+	if (method == cv::TM_SQDIFF_NORMED)
+		result.convertTo(result, CV_32F, -1.0, 1.0);
+
+	// Masked windows without any variance divide by zero
+	if (masked)
+		cv::patchNaNs(result, 0.0);
+}
+
+// Scales from min to max in steps from the original size, which is always one of them
+static std::vector<double> scale_factors(double min_scale, double max_scale)
+{
+	std::vector<double> factors;
+	min_scale = std::min(min_scale, 1.0);
+	for (double scale = 1.0; scale >= min_scale; scale /= SCALE_STEP)
+		factors.insert(factors.begin(), scale);
+	for (double scale = SCALE_STEP; scale <= max_scale; scale *= SCALE_STEP)
+		factors.push_back(scale);
+	return factors;
+}
+
+TemplateMatcher::ScaledTemplate::ScaledTemplate(const cv::Mat &image, const cv::Mat &mask,
+						double scale, int pyramid_levels, int method)
+	: scale(scale), kernel(image)
+{
+	pyramid.push_back(image);
+	if (!mask.empty())
+		masks.push_back(mask);
+	for (int level = 1; level <= pyramid_levels; level++) {
+		const cv::Mat &previous = pyramid.back();
+		if (previous.cols / 2 < PYRAMID_MIN_SIZE || previous.rows / 2 < PYRAMID_MIN_SIZE)
+			break;
+
+		cv::Mat downscaled;
+		cv::pyrDown(previous, downscaled);
+		pyramid.push_back(downscaled);
+
+		if (!mask.empty()) {
+			// Pixels mostly under the mask stay under it
+			cv::Mat level_mask;
+			cv::pyrDown(masks.back(), level_mask);
+			cv::threshold(level_mask, level_mask, 127, 255, cv::THRESH_BINARY);
+			masks.push_back(level_mask);
+		}
+	}
+
+	// Template statistics are computed here once instead of on every frame
+	if (method == cv::TM_CCOEFF_NORMED) {
+		static const cv::Mat no_mask;
+		for (size_t level = 0; level < pyramid.size(); level++)
+			correlators.emplace_back(pyramid[level],
+						 masks.empty() ? no_mask : masks[level]);
+	}
+}
+
+TemplateMatcher::TemplateMatcher(size_t slot, const std::string &path, const cv::Mat &image,
+				 const cv::Mat &mask, double threshold, int pyramid_levels,
+				 int method, double min_scale, double max_scale)
+	: m_Slot(slot),
+	  m_Path(path),
+	  m_Threshold(threshold),
+	  m_Method(method),
+	  m_PyramidLevels(pyramid_levels),
+	  m_MinScale(min_scale),
+	  m_MaxScale(max_scale),
+	  m_Settings{threshold, 0, threshold, 1, 1},
+	  m_SettingsChanged(false),
+	  m_Image(image),
+	  m_Mask(mask),
+	  m_Current(0),
+	  m_Other(0),
+	  m_Unsearched(0),
+	  m_Deadline(0),
+	  m_OutOfTime(false),
+	  m_MaxMisses(0),
+	  m_Misses(0),
+	  m_ReleaseThreshold(threshold),
+	  m_ConfirmFrames(1),
+	  m_ConfirmMask(1),
+	  m_Hits(0),
+	  m_Detected(false),
+	  m_LastScore(0.0),
+	  m_KeepScoreMap(false)
+{
+	for (double scale : scale_factors(min_scale, max_scale)) {
+		if (scale == 1.0) {
+			m_Current = (int)m_Scales.size();
+			m_Scales.emplace_back(image, mask, scale, pyramid_levels, method);
+			continue;
+		}
+
+		cv::Size size((int)std::lround(image.cols * scale),
+			      (int)std::lround(image.rows * scale));
+		if (size.width < PYRAMID_MIN_SIZE || size.height < PYRAMID_MIN_SIZE)
+			continue;
+
+		cv::Mat resized;
+		cv::resize(image, resized, size, 0, 0,
+			   scale < 1.0 ? cv::INTER_AREA : cv::INTER_LINEAR);
+		cv::Mat resized_mask;
+		if (!mask.empty()) {
+			cv::resize(mask, resized_mask, size, 0, 0, cv::INTER_NEAREST);
+			// Scaled down far enough, a thin mask may lose all of its pixels
+			if (cv::countNonZero(resized_mask) == 0)
+				continue;
+		}
+		m_Scales.emplace_back(resized, resized_mask, scale, pyramid_levels, method);
+	}
+	m_Other = m_Current;
+}
+
+size_t TemplateMatcher::Slot() const
+{
+	return m_Slot;
+}
+
+const std::string &TemplateMatcher::Path() const
+{
+	return m_Path;
+}
+
+const cv::Mat &TemplateMatcher::Image() const
+{
+	return m_Image;
+}
+
+const cv::Mat &TemplateMatcher::Mask() const
+{
+	return m_Mask;
+}
+
+cv::Size TemplateMatcher::Size() const
+{
+	return m_Scales[m_Current].pyramid[0].size();
+}
+
+double TemplateMatcher::Threshold() const
+{
+	return m_Threshold;
+}
+
+void TemplateMatcher::SetThreshold(double threshold)
+{
+	std::lock_guard<std::mutex> lock(m_SettingsMutex);
+	m_Settings.threshold = threshold;
+	m_SettingsChanged = true;
+}
+
+int TemplateMatcher::Method() const
+{
+	return m_Method;
+}
+
+int TemplateMatcher::PyramidLevels() const
+{
+	// Larger scales may be downscaled further than the original
+	int levels = 0;
+	for (const ScaledTemplate &scaled : m_Scales)
+		levels = std::max(levels, (int)scaled.pyramid.size() - 1);
+	return levels;
+}
+
+int TemplateMatcher::Scales() const
+{
+	return (int)m_Scales.size();
+}
+
+double TemplateMatcher::Scale() const
+{
+	return m_Scales[m_Current].scale;
+}
+
+bool TemplateMatcher::SameSearch(const std::string &path, int pyramid_levels, int method,
+				 double min_scale, double max_scale) const
+{
+	return path == m_Path && pyramid_levels == m_PyramidLevels && method == m_Method &&
+	       min_scale == m_MinScale && max_scale == m_MaxScale;
+}
+
+void TemplateMatcher::SetTracking(int max_misses)
+{
+	std::lock_guard<std::mutex> lock(m_SettingsMutex);
+	m_Settings.max_misses = max_misses;
+	m_SettingsChanged = true;
+}
+
+const cv::Rect &TemplateMatcher::TrackingWindow() const
+{
+	return m_Window;
+}
+
+void TemplateMatcher::SetDebounce(double release_threshold, int confirm_frames,
+				  int confirm_window)
+{
+	std::lock_guard<std::mutex> lock(m_SettingsMutex);
+	m_Settings.release_threshold = release_threshold;
+	m_Settings.confirm_frames = confirm_frames;
+	m_Settings.confirm_window = confirm_window;
+	m_SettingsChanged = true;
+}
+
+void TemplateMatcher::applySettings()
+{
+	if (!m_SettingsChanged)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_SettingsMutex);
+	m_SettingsChanged = false;
+	m_Threshold = m_Settings.threshold;
+	m_ReleaseThreshold = std::min(m_Settings.release_threshold, m_Threshold);
+
+	if (m_Settings.max_misses != m_MaxMisses) {
+		m_MaxMisses = m_Settings.max_misses;
+		m_Misses = 0;
+		m_Window = cv::Rect();
+	}
+
+	int confirm_window = std::min(std::max(m_Settings.confirm_window, 1), 32);
+	int confirm_frames = std::min(std::max(m_Settings.confirm_frames, 1), confirm_window);
+	uint32_t confirm_mask = confirm_window == 32 ? 0xFFFFFFFFu : (1u << confirm_window) - 1;
+	if (confirm_frames != m_ConfirmFrames || confirm_mask != m_ConfirmMask) {
+		m_ConfirmFrames = confirm_frames;
+		m_ConfirmMask = confirm_mask;
+		m_Hits = 0;
+		m_Detected = false;
+	}
+}
+
+bool TemplateMatcher::Debounced() const
+{
+	return m_ReleaseThreshold < m_Threshold || m_ConfirmFrames > 1;
+}
+
+void TemplateMatcher::SetScoreMap(bool enabled)
+{
+	m_KeepScoreMap = enabled;
+	if (!enabled)
+		m_ScoreMap.release();
+}
+
+const cv::Mat &TemplateMatcher::ScoreMap() const
+{
+	return m_ScoreMap;
+}
+
+const cv::Rect &TemplateMatcher::ScoreMapArea() const
+{
+	return m_ScoreMapArea;
+}
+
+MatchResult TemplateMatcher::Match(const std::vector<cv::Mat> &pyramid, const cv::Point &origin,
+				   uint64_t deadline)
+{
+	applySettings();
+
+	// Stays empty unless the search scores the whole image
+	m_ScoreMapArea = cv::Rect();
+	m_Deadline = deadline;
+	m_OutOfTime = false;
+
+	// Current scale first so it wins ties. The tracking window is sized for the current
+	// scale, so only it is searched while tracking. Otherwise the scales next to it are
+	// searched too, and while the template isn't detected one of the others in turn, so a
+	// change of resolution is found within a round of the scales.
+	int scales[4] = {m_Current};
+	int count = 1;
+	if (m_Window.empty()) {
+		if (m_Current > 0)
+			scales[count++] = m_Current - 1;
+		if (m_Current + 1 < (int)m_Scales.size())
+			scales[count++] = m_Current + 1;
+		if (!m_Detected && (int)m_Scales.size() > count) {
+			do {
+				m_Other = (m_Other + 1) % (int)m_Scales.size();
+			} while (std::abs(m_Other - m_Current) <= 1);
+			scales[count++] = m_Other;
+			if (m_Unsearched > 0)
+				m_Unsearched--;
+		}
+	}
+
+	MatchResult match = matchScale(m_Scales[m_Current], pyramid, origin);
+	int best = m_Current;
+	for (int i = 1; i < count && !outOfTime(); i++) {
+		MatchResult scaled = matchScale(m_Scales[scales[i]], pyramid, origin);
+		if (scaled.score > match.score) {
+			match = scaled;
+			best = scales[i];
+		}
+	}
+
+	// Remembered once it scores the threshold, a near miss of another scale isn't enough
+	if (match.score >= m_Threshold)
+		m_Current = best;
+
+	// A miss of a search cut short doesn't say the template isn't there
+	if (m_OutOfTime && match.score < m_Threshold) {
+		match.detected = false;
+		match.unfinished = true;
+		return match;
+	}
+
+	decide(match);
+
+	return match;
+}
+
+void TemplateMatcher::ImageChanged()
+{
+	int first = std::max(m_Current - 1, 0);
+	int last = std::min(m_Current + 1, (int)m_Scales.size() - 1);
+	m_Unsearched = (int)m_Scales.size() - (last - first + 1);
+}
+
+bool TemplateMatcher::Settled() const
+{
+	// New settings may decide the same score differently
+	if (m_SettingsChanged)
+		return false;
+
+	// Scales searched in turn haven't all had theirs on this image
+	if (m_Unsearched > 0 && !m_Detected && m_Window.empty())
+		return false;
+
+	// Debouncing the same score again would change nothing
+	uint32_t hits = ((m_Hits << 1) | (m_LastScore >= m_Threshold ? 1u : 0u)) & m_ConfirmMask;
+	if (hits != (m_Hits & m_ConfirmMask))
+		return false;
+	if (m_Detected)
+		return m_LastScore >= m_ReleaseThreshold;
+	return (int)std::bitset<32>(hits).count() < m_ConfirmFrames;
+}
+
+bool TemplateMatcher::outOfTime()
+{
+	if (!m_OutOfTime && m_Deadline != 0 && os_gettime_ns() > m_Deadline)
+		m_OutOfTime = true;
+	return m_OutOfTime;
+}
+
+MatchResult TemplateMatcher::matchScale(ScaledTemplate &scaled,
+					const std::vector<cv::Mat> &pyramid,
+					const cv::Point &origin)
+{
+	const cv::Size size = scaled.pyramid[0].size();
+
+	// Template doesn't fit inside the search image
+	if (pyramid[0].cols < size.width || pyramid[0].rows < size.height)
+		return {0.0, cv::Point(), false};
+
+	if (!m_Window.empty()) {
+		// Tracking window is small, so it's searched at full resolution
+		cv::Rect window = (m_Window - origin) & cv::Rect(cv::Point(), pyramid[0].size());
+		if (window.width >= size.width && window.height >= size.height)
+			return matchWindow(scaled, pyramid[0], window);
+	}
+
+	int level = std::min((int)scaled.pyramid.size() - 1, (int)pyramid.size() - 1);
+	// Coarse level of the search image may be rounded smaller than the template
+	while (level > 0 && (pyramid[level].cols < scaled.pyramid[level].cols ||
+			     pyramid[level].rows < scaled.pyramid[level].rows))
+		level--;
+
+	if (level == 0)
+		return matchFull(scaled, pyramid[0]);
+
+	return matchCoarseToFine(scaled, pyramid, level);
+}
+
+void TemplateMatcher::decide(MatchResult &match)
+{
+	m_LastScore = match.score;
+	m_Hits = (m_Hits << 1) | (match.score >= m_Threshold ? 1u : 0u);
+
+	if (m_Detected) {
+		m_Detected = match.score >= m_ReleaseThreshold;
+	} else {
+		int hits = (int)std::bitset<32>(m_Hits & m_ConfirmMask).count();
+		m_Detected = hits >= m_ConfirmFrames;
+	}
+
+	match.detected = m_Detected;
+}
+
+void TemplateMatcher::Track(const MatchResult &match, const cv::Point &origin,
+			    const cv::Rect &bounds)
+{
+	if (m_MaxMisses <= 0)
+		return;
+
+	if (match.detected) {
+		m_LastMatch = cv::Rect(match.location + origin, Size());
+		m_Misses = 0;
+	} else if (m_Window.empty()) {
+		return;
+	} else if (++m_Misses > m_MaxMisses) {
+		// Lost the template, back to searching the whole region
+		m_Window = cv::Rect();
+		return;
+	}
+
+	// Margin around the last match doubles on every miss in a row
+	int scale = 1 << std::min(m_Misses, 16);
+	cv::Size margin(std::max(Size().width / 2, 1) * scale,
+			std::max(Size().height / 2, 1) * scale);
+	m_Window = cv::Rect(m_LastMatch.tl() - cv::Point(margin.width, margin.height),
+			    m_LastMatch.size() + margin + margin) &
+		   bounds;
+}
+
+MatchResult TemplateMatcher::matchFull(ScaledTemplate &scaled, const cv::Mat &gray)
+{
+	MatchResult match = {0.0, cv::Point(), false};
+
+	const cv::Size size = scaled.pyramid[0].size();
+	int64_t positions = (int64_t)(gray.cols - size.width + 1) * (gray.rows - size.height + 1);
+	if (useKernel(scaled) && positions * size.area() <= DIRECT_MAX_WORK)
+		return matchDirect(scaled, gray, cv::Rect(cv::Point(), gray.size()));
+
+	score(scaled, gray, 0, scaled.result);
+	cv::minMaxLoc(scaled.result, nullptr, &match.score, nullptr, &match.location);
+	keepScoreMap(scaled, scaled.result, 1);
+
+	return match;
+}
+
+MatchResult TemplateMatcher::matchWindow(ScaledTemplate &scaled, const cv::Mat &gray,
+					 const cv::Rect &window)
+{
+	if (useKernel(scaled))
+		return matchDirect(scaled, gray, window);
+
+	MatchResult match = {0.0, cv::Point(), false};
+
+	// Windows are small and change size every frame, so the spectrum wouldn't be reused
+	cv::matchTemplate(gray(window), scaled.pyramid[0], scaled.window_result, m_Method,
+			  levelMask(scaled, 0));
+	to_similarity(scaled.window_result, m_Method, !scaled.masks.empty());
+	cv::minMaxLoc(scaled.window_result, nullptr, &match.score, nullptr, &match.location);
+	match.location += window.tl();
+
+	return match;
+}
+
+MatchResult TemplateMatcher::matchDirect(ScaledTemplate &scaled, const cv::Mat &gray,
+					 const cv::Rect &window)
+{
+	MatchResult match = {0.0, cv::Point(), false};
+
+	const cv::Size size = scaled.pyramid[0].size();
+	cv::Rect search = window;
+	// A detected template only has to stay over the release threshold
+	double stop_score = m_Detected ? m_ReleaseThreshold : m_Threshold;
+	NccPeak peak = scaled.kernel.Match(gray(search), stop_score);
+	if (peak.score >= stop_score) {
+		// Search stopped at the first position over the threshold in raster order, so the
+		// peak is on the rows below it within half a template from it
+		cv::Rect around(search.x + peak.x - size.width / 2, search.y + peak.y,
+				2 * size.width, size.height + size.height / 2);
+		search &= around;
+		peak = scaled.kernel.Match(gray(search), 2.0);
+	}
+
+	match.score = peak.score;
+	match.location = search.tl() + cv::Point(peak.x, peak.y);
+
+	return match;
+}
+
+MatchResult TemplateMatcher::matchCoarseToFine(ScaledTemplate &scaled,
+					       const std::vector<cv::Mat> &pyramid, int level)
+{
+	MatchResult match = {-1.0, cv::Point(), false};
+
+	const cv::Mat &gray = pyramid[0];
+	const cv::Size size = scaled.pyramid[0].size();
+	const cv::Mat &coarse_template = scaled.pyramid[level];
+	score(scaled, pyramid[level], level, scaled.result);
+
+	const int scale = 1 << level;
+	// Before the candidates suppress their neighbourhoods
+	keepScoreMap(scaled, scaled.result, scale);
+	const cv::Rect coarse_bounds(cv::Point(), scaled.result.size());
+	const cv::Rect bounds(cv::Point(), gray.size());
+
+	// First candidate is always refined, the rest only while there is time
+	for (int i = 0; i < PYRAMID_CANDIDATES && (i == 0 || !outOfTime()); i++) {
+		double coarse_score;
+		cv::Point coarse_location;
+		cv::minMaxLoc(scaled.result, nullptr, &coarse_score, nullptr, &coarse_location);
+		// Rest of the scores were suppressed by earlier candidates
+		if (coarse_score < -1.0)
+			break;
+
+		// Suppress the neighbourhood so the next candidate is a different location
+		cv::Rect suppressed(coarse_location - cv::Point(coarse_template.cols / 2,
+								 coarse_template.rows / 2),
+				    coarse_template.size());
+		scaled.result(suppressed & coarse_bounds).setTo(-2.0f);
+
+		// Downscaling rounds the location by up to a coarse pixel in each direction
+		cv::Rect window(coarse_location * scale - cv::Point(scale, scale),
+				size + cv::Size(2 * scale, 2 * scale));
+		window &= bounds;
+		if (window.width < size.width || window.height < size.height)
+			continue;
+
+		MatchResult refined = matchWindow(scaled, gray, window);
+		if (refined.score > match.score)
+			match = refined;
+	}
+
+	return match;
+}
+
+void TemplateMatcher::score(ScaledTemplate &scaled, const cv::Mat &image, int level,
+			    cv::Mat &result)
+{
+	if (!scaled.correlators.empty()) {
+		scaled.correlators[level].Match(image, result);
+		return;
+	}
+
+	cv::matchTemplate(image, scaled.pyramid[level], result, m_Method,
+			  levelMask(scaled, level));
+	to_similarity(result, m_Method, !scaled.masks.empty());
+}
+
+bool TemplateMatcher::useKernel(const ScaledTemplate &scaled) const
+{
+	return m_Method == cv::TM_CCOEFF_NORMED && scaled.masks.empty() &&
+	       scaled.kernel.Usable();
+}
+
+const cv::Mat &TemplateMatcher::levelMask(const ScaledTemplate &scaled, int level) const
+{
+	static const cv::Mat no_mask;
+	return scaled.masks.empty() ? no_mask : scaled.masks[level];
+}
+
+void TemplateMatcher::keepScoreMap(const ScaledTemplate &scaled, const cv::Mat &scores,
+				   int scale)
+{
+	if (!m_KeepScoreMap || &scaled != &m_Scales[m_Current])
+		return;
+
+	// The buffer is reused while the search image keeps its size
+	cv::Size size = scores.size();
+	if (size.width > SCORE_MAP_WIDTH)
+		size = cv::Size(SCORE_MAP_WIDTH,
+				std::max(1, size.height * SCORE_MAP_WIDTH / size.width));
+	cv::resize(scores, m_ScoreMap, size, 0, 0, cv::INTER_AREA);
+	m_ScoreMapArea = cv::Rect(cv::Point(), scores.size() * scale);
+}
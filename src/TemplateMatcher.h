@@ -0,0 +1,234 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef TEMPLATEMATCHER_H
+#define TEMPLATEMATCHER_H
+
+#ifdef __cplusplus
+#undef NO
+#undef YES
+#include <opencv2/opencv.hpp>
+#endif
+
+#include "FftCorrelator.h"
+#include "NccKernel.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct MatchResult {
+	// Higher is more similar whatever the method, squared differences are inverted to 0..1
+	double score;
+	// Top left corner of the best match in the search image
+	cv::Point location;
+	bool detected;
+	// Deadline passed before the search was finished without finding the template so far,
+	// the detection state of the template was left as it was
+	bool unfinished;
+};
+
+// One template of a filter along with its own detection settings. Created on the settings
+// thread and afterwards only matched by the matcher thread. The detection settings may still
+// be changed from the settings thread, they take effect on the next search.
+class TemplateMatcher {
+public:
+	// With pyramid levels the template is first searched at 1/2^levels scale and only the
+	// best candidates are refined at full resolution. Method is a cv::TemplateMatchModes,
+	// only TM_CCOEFF_NORMED gets the FFT correlator and the direct kernel, the others are
+	// searched with cv::matchTemplate. Mask is 8-bit, nonzero where the template counts, or
+	// empty to use every pixel. The template is also searched resized between min_scale and
+	// max_scale, for sources whose resolution or UI scale changes.
+	TemplateMatcher(size_t slot, const std::string &path, const cv::Mat &image,
+			const cv::Mat &mask, double threshold, int pyramid_levels, int method,
+			double min_scale = 1.0, double max_scale = 1.0);
+
+	// Index of the template in the filter settings
+	size_t Slot() const;
+	const std::string &Path() const;
+	const cv::Mat &Image() const;
+	const cv::Mat &Mask() const;
+	// Size at the current scale
+	cv::Size Size() const;
+	double Threshold() const;
+	void SetThreshold(double threshold);
+	int Method() const;
+	// Levels actually used, small templates can't be downscaled as far as requested
+	int PyramidLevels() const;
+	// Number of scales the template is resized to
+	int Scales() const;
+	// Scale the template was last found at, 1 is the size of the image. Only this scale and
+	// the ones next to it are searched on every frame.
+	double Scale() const;
+	// Created from the image at the path with these search settings, so it can be kept when
+	// only the detection settings change
+	bool SameSearch(const std::string &path, int pyramid_levels, int method, double min_scale,
+			double max_scale) const;
+
+	// After a detection only a window around it is searched, growing on every miss until
+	// the template is lost after max_misses frames in a row. Zero disables tracking. The
+	// window is only dropped when the setting changes.
+	void SetTracking(int max_misses);
+	// Frame area the template is searched from next, empty when it isn't tracked
+	const cv::Rect &TrackingWindow() const;
+
+	// Debounces detections. The template is detected once at least confirm_frames of the
+	// last confirm_window frames (at most 32) score the threshold, and stays detected until a
+	// frame scores below the release threshold. One of one at the threshold detects every
+	// frame that scores it. The frames counted so far are only dropped when the frame counts
+	// change.
+	void SetDebounce(double release_threshold, int confirm_frames, int confirm_window);
+	// Anything but one of one at the threshold
+	bool Debounced() const;
+
+	// Finds the best match of the template in a pyramid of the gray search image, level 0
+	// being the full resolution image with its top left corner at origin in the frame.
+	// Only touches state of this template, so different templates can be matched against
+	// the same pyramid in parallel. Past the deadline (os_gettime_ns, zero for none) no more
+	// scales or candidates are searched.
+	MatchResult Match(const std::vector<cv::Mat> &pyramid, const cv::Point &origin,
+			  uint64_t deadline = 0);
+
+	// The next search image differs from the last one, so every scale gets searched on it
+	// again
+	void ImageChanged();
+	// Matching the same search image again would give the same result. Until then, debouncing
+	// still counts frames or other scales are still to be searched on it.
+	bool Settled() const;
+
+	// Moves the tracking window after matching, it's kept inside the bounds of the frame
+	void Track(const MatchResult &match, const cv::Point &origin, const cv::Rect &bounds);
+
+	// Keeps a downscaled copy of the scores of every position searched on the last frame.
+	// Only searches that score the whole image leave one, windows and the direct kernel
+	// don't.
+	void SetScoreMap(bool enabled);
+	const cv::Mat &ScoreMap() const;
+	// Positions of the search image the map covers, each at the top left of its template.
+	// Empty if the last search didn't leave a map.
+	const cv::Rect &ScoreMapArea() const;
+
+private:
+	// Detection settings waiting for the next search
+	struct Settings {
+		double threshold;
+		int max_misses;
+		double release_threshold;
+		int confirm_frames;
+		int confirm_window;
+	};
+
+	// Template resized to one scale, with everything needed to search it
+	struct ScaledTemplate {
+		ScaledTemplate(const cv::Mat &image, const cv::Mat &mask, double scale,
+			       int pyramid_levels, int method);
+
+		double scale;
+		// Template downscaled for each pyramid level, level 0 is the resized image
+		std::vector<cv::Mat> pyramid;
+		// Mask of each level, empty without one
+		std::vector<cv::Mat> masks;
+		// Frequency domain search for each pyramid level, empty for other methods
+		std::vector<FftCorrelator> correlators;
+		// Direct search for small unmasked templates and windows
+		NccKernel kernel;
+
+		// Scores of the last search, each scale keeps its own so their sizes stay put
+		cv::Mat result;
+		cv::Mat window_result;
+	};
+
+	MatchResult matchScale(ScaledTemplate &scaled, const std::vector<cv::Mat> &pyramid,
+			       const cv::Point &origin);
+	MatchResult matchFull(ScaledTemplate &scaled, const cv::Mat &gray);
+	// Direct search of a small window, location is relative to the whole image
+	MatchResult matchWindow(ScaledTemplate &scaled, const cv::Mat &gray,
+				const cv::Rect &window);
+	// Window with the 8-bit kernel, stopping early once the template is detected
+	MatchResult matchDirect(ScaledTemplate &scaled, const cv::Mat &gray,
+				const cv::Rect &window);
+	MatchResult matchCoarseToFine(ScaledTemplate &scaled, const std::vector<cv::Mat> &pyramid,
+				      int level);
+	// Scores every position of the template of the level with the method
+	void score(ScaledTemplate &scaled, const cv::Mat &image, int level, cv::Mat &result);
+	bool useKernel(const ScaledTemplate &scaled) const;
+	// Empty without a mask
+	const cv::Mat &levelMask(const ScaledTemplate &scaled, int level) const;
+	// Takes the settings changed since the last search
+	void applySettings();
+	// Sets detected from the score and the frames before
+	void decide(MatchResult &match);
+	// Deadline of the current search has passed
+	bool outOfTime();
+	// Scores at scale times the resolution of the search image, only the current template
+	// scale keeps its map
+	void keepScoreMap(const ScaledTemplate &scaled, const cv::Mat &scores, int scale);
+
+	size_t m_Slot;
+	std::string m_Path;
+	double m_Threshold;
+	int m_Method;
+	// As requested, the levels used may be fewer
+	int m_PyramidLevels;
+	double m_MinScale;
+	double m_MaxScale;
+
+	std::mutex m_SettingsMutex;
+	Settings m_Settings;
+	std::atomic<bool> m_SettingsChanged;
+
+	// As loaded, before resizing
+	cv::Mat m_Image;
+	cv::Mat m_Mask;
+
+	// Smallest scale first
+	std::vector<ScaledTemplate> m_Scales;
+	// Scale the template was last found at
+	int m_Current;
+	// Other scale searched last, these take turns while the template isn't detected
+	int m_Other;
+	// Other scales not yet searched on the current search image
+	int m_Unsearched;
+
+	// Of the current search, the search was cut short once it passed
+	uint64_t m_Deadline;
+	bool m_OutOfTime;
+
+	int m_MaxMisses;
+	int m_Misses;
+	cv::Rect m_LastMatch;
+	cv::Rect m_Window;
+
+	double m_ReleaseThreshold;
+	int m_ConfirmFrames;
+	uint32_t m_ConfirmMask;
+	// Bit per frame scoring the threshold, newest lowest
+	uint32_t m_Hits;
+	bool m_Detected;
+	double m_LastScore;
+
+	bool m_KeepScoreMap;
+	cv::Mat m_ScoreMap;
+	cv::Rect m_ScoreMapArea;
+};
+
+typedef std::vector<std::shared_ptr<TemplateMatcher>> TemplateList;
+
+#endif // !TEMPLATEMATCHER_H
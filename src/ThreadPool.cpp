@@ -0,0 +1,253 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+namespace {
+
+// Worker the current thread is, so its submissions stay on its own queue
+thread_local const ThreadPool *current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+} // namespace
+
+struct ThreadPool::ParallelForState {
+	std::atomic<int> next;
+	std::atomic<int> done;
+	int count;
+	// Only called for indices below count, which all finish before ParallelFor returns, so
+	// the body outlives every call even though the state may outlive the body
+	const std::function<void(int)> *body;
+
+	std::mutex mutex;
+	std::condition_variable finished;
+
+	// Takes indices until there are none left
+	void Work()
+	{
+		int completed = 0;
+		for (int i = next++; i < count; i = next++) {
+			(*body)(i);
+			completed++;
+		}
+		if (completed == 0)
+			return;
+
+		if (done.fetch_add(completed) + completed == count) {
+			std::lock_guard<std::mutex> lock(mutex);
+			finished.notify_all();
+		}
+	}
+};
+
+ThreadPool::ThreadPool(size_t threads) : m_NextWorker(0), m_Queued(0), m_Stopping(false)
+{
+	if (threads == 0)
+		threads = 1;
+
+	for (size_t i = 0; i < threads; i++)
+		m_Workers.push_back(std::make_unique<Worker>());
+
+	for (size_t i = 0; i < threads; i++)
+		m_Threads.emplace_back(&ThreadPool::run, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_SleepMutex);
+		m_Stopping = true;
+	}
+	m_Wake.notify_all();
+
+	for (std::thread &thread : m_Threads)
+		thread.join();
+}
+
+size_t ThreadPool::Size() const
+{
+	return m_Workers.size();
+}
+
+void ThreadPool::Submit(std::function<void()> job)
+{
+	{
+		Worker &worker = target();
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.jobs.push_back(std::move(job));
+		m_Queued++;
+	}
+	wake();
+}
+
+ThreadPool::Worker &ThreadPool::target()
+{
+	size_t index = current_pool == this ? current_worker
+					     : m_NextWorker++ % m_Workers.size();
+	return *m_Workers[index];
+}
+
+void ThreadPool::wake()
+{
+	// Taking the lock makes sure a worker is either sleeping or yet to check the count
+	{
+		std::lock_guard<std::mutex> lock(m_SleepMutex);
+	}
+	m_Wake.notify_one();
+}
+
+std::shared_ptr<ThreadPool::ParallelForState> ThreadPool::acquireState()
+{
+	// States of the earlier ParallelFors of this thread. Helpers may start after everything
+	// is done, so a state is only reused once no helper holds it anymore.
+	thread_local std::vector<std::shared_ptr<ParallelForState>> states;
+	for (const std::shared_ptr<ParallelForState> &state : states) {
+		if (state.use_count() == 1)
+			return state;
+	}
+	states.push_back(std::make_shared<ParallelForState>());
+	return states.back();
+}
+
+void ThreadPool::ParallelFor(int count, const std::function<void(int)> &body)
+{
+	if (count <= 0)
+		return;
+	if (count == 1) {
+		body(0);
+		return;
+	}
+
+	std::shared_ptr<ParallelForState> state = acquireState();
+	state->next = 0;
+	state->done = 0;
+	state->count = count;
+	state->body = &body;
+
+	size_t helpers = std::min(m_Workers.size(), (size_t)count - 1);
+	for (size_t i = 0; i < helpers; i++) {
+		{
+			Worker &worker = target();
+			std::lock_guard<std::mutex> lock(worker.mutex);
+			worker.helpers.push_back(state);
+			m_Queued++;
+		}
+		wake();
+	}
+
+	state->Work();
+
+	{
+		std::unique_lock<std::mutex> lock(state->mutex);
+		state->finished.wait(lock, [&state] { return state->done == state->count; });
+	}
+
+	// Helpers that haven't started would find nothing left to do. Left queued they would
+	// pile up behind a caller that keeps doing all the work itself.
+	for (const std::unique_ptr<Worker> &worker : m_Workers) {
+		std::lock_guard<std::mutex> lock(worker->mutex);
+		auto stale = std::remove(worker->helpers.begin(), worker->helpers.end(), state);
+		m_Queued -= worker->helpers.end() - stale;
+		worker->helpers.erase(stale, worker->helpers.end());
+	}
+}
+
+void ThreadPool::run(size_t index)
+{
+	current_pool = this;
+	current_worker = index;
+
+	while (true) {
+		std::function<void()> job;
+		std::shared_ptr<ParallelForState> helper;
+		if (pop(index, job, helper)) {
+			if (helper)
+				helper->Work();
+			else
+				job();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_SleepMutex);
+		m_Wake.wait(lock, [this] { return m_Stopping || m_Queued > 0; });
+		if (m_Stopping)
+			return;
+	}
+}
+
+// Takes the oldest job of the worker, the storage is kept for the next ones
+static bool take_job(std::vector<std::function<void()>> &jobs, size_t &head,
+		     std::function<void()> &job)
+{
+	if (head == jobs.size())
+		return false;
+
+	job = std::move(jobs[head++]);
+	if (head == jobs.size()) {
+		jobs.clear();
+		head = 0;
+	} else if (head * 2 > jobs.size()) {
+		// Never empties under a steady load, the taken half is moved out of the way
+		jobs.erase(jobs.begin(), jobs.begin() + head);
+		head = 0;
+	}
+	return true;
+}
+
+bool ThreadPool::pop(size_t index, std::function<void()> &job,
+		     std::shared_ptr<ParallelForState> &helper)
+{
+	// Newest helper of our own queue first, it's the most likely to be in the cache, then
+	// the oldest job
+	{
+		Worker &own = *m_Workers[index];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.helpers.empty()) {
+			helper = std::move(own.helpers.back());
+			own.helpers.pop_back();
+			m_Queued--;
+			return true;
+		}
+		if (take_job(own.jobs, own.head, job)) {
+			m_Queued--;
+			return true;
+		}
+	}
+
+	// Steal from the other workers, helpers of a running ParallelFor before new jobs
+	for (int helpers = 1; helpers >= 0; helpers--) {
+		for (size_t i = 1; i < m_Workers.size(); i++) {
+			Worker &victim = *m_Workers[(index + i) % m_Workers.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (helpers && !victim.helpers.empty()) {
+				helper = std::move(victim.helpers.front());
+				victim.helpers.erase(victim.helpers.begin());
+				m_Queued--;
+				return true;
+			}
+			if (!helpers && take_job(victim.jobs, victim.head, job)) {
+				m_Queued--;
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,87 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing thread pool shared by every filter of the plugin. Each worker has its own
+// job queue, jobs submitted from a worker go to its own queue and idle workers steal from
+// the others. Jobs run in the order they were submitted, only the helpers of a ParallelFor
+// run newest first ahead of them. Workers sleep while there are no jobs, so idle filters
+// cost nothing. Queues keep their storage, so a steady load doesn't allocate.
+class ThreadPool {
+public:
+	explicit ThreadPool(size_t threads);
+	// Jobs still queued are run before the workers exit
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	size_t Size() const;
+
+	// Runs after the jobs already queued on the worker, so a job that submits itself again
+	// can't keep a worker to itself
+	void Submit(std::function<void()> job);
+
+	// Runs body for every index in [0, count) across the pool and returns once all are done.
+	// The calling thread takes part, so jobs can use it without starving the pool. Doesn't
+	// allocate once the thread has run a ParallelFor before.
+	void ParallelFor(int count, const std::function<void(int)> &body);
+
+private:
+	struct ParallelForState;
+
+	struct Worker {
+		std::mutex mutex;
+		// Submitted jobs, oldest first from the head
+		std::vector<std::function<void()>> jobs;
+		size_t head = 0;
+		// ParallelFor helpers, their caller is waiting for them so they go first
+		std::vector<std::shared_ptr<ParallelForState>> helpers;
+	};
+
+	static std::shared_ptr<ParallelForState> acquireState();
+
+	Worker &target();
+	void wake();
+	void run(size_t index);
+	bool pop(size_t index, std::function<void()> &job,
+		 std::shared_ptr<ParallelForState> &helper);
+
+	std::vector<std::unique_ptr<Worker>> m_Workers;
+	std::vector<std::thread> m_Threads;
+
+	// Queue for jobs submitted from outside the pool, picked round robin
+	std::atomic<size_t> m_NextWorker;
+	std::atomic<size_t> m_Queued;
+
+	std::mutex m_SleepMutex;
+	std::condition_variable m_Wake;
+	bool m_Stopping;
+};
+
+#endif // !THREADPOOL_H
@@ -18,6 +18,10 @@ with this program. If not, see <https://www.gnu.org/licenses/>
 
 #include "audio.h"
 
+#include <algorithm>
+#include <list>
+#include <mutex>
+
 SineOscillator::SineOscillator(float freq, float amp) : frequency(freq), amplitude(amp)
 {
 	offset = 2 * (float)M_PI * frequency / sampleRate;
@@ -30,40 +34,117 @@ float SineOscillator::process()
 	return sample;
 }
 
-std::vector<uint8_t> PcmToWave(std::vector<uint16_t> pcm)
-{
-	static_assert(sizeof(wav_hdr) == 44, "");
+// Keeps the most recently used sequences up to this many bytes of samples, older ones live on
+// only while a filter holds them
+const size_t maxCachedBytes = 64 * 1024 * 1024;
+std::list<BeepSequencePtr> sequenceCache;
+size_t sequenceCacheBytes = 0;
+std::mutex sequenceCacheMutex;
 
-	uint32_t fsize = (uint32_t)pcm.size() * 2;
+// Beeps are cut short at this length, a longer one would take gigabytes of samples
+const int maxBeepLength = 60000;
+// Consecutive beeps go into one segment up to this many samples, so its WAV sizes fit
+const size_t maxSegmentSamples = (size_t)sampleRate * 600;
+
+static void FinishSegment(BeepSegment &segment)
+{
+	uint32_t fsize = (uint32_t)(segment.wave.size() - sizeof(wav_hdr));
 
 	wav_hdr wav;
 	wav.ChunkSize = fsize + sizeof(wav_hdr) - 8;
-	wav.Subchunk2Size = fsize + sizeof(wav_hdr) - 44;
+	wav.Subchunk2Size = fsize;
+	memcpy(segment.wave.data(), &wav, sizeof(wav));
+}
+
+static std::shared_ptr<BeepSequence> RenderSequence(const std::vector<Event> &events)
+{
+	static_assert(sizeof(wav_hdr) == 44, "");
+
+	auto sequence = std::make_shared<BeepSequence>();
+	sequence->events = events;
+	sequence->duration_ns = 0;
+	sequence->bytes = 0;
+
+	auto maxAmplitude = pow(2, bitDepth - 1) - 1;
+	// Waits end the segment before them
+	bool waited = true;
+	for (const Event &e : events) {
+		if (e.length <= 0)
+			continue;
+
+		uint64_t start = sequence->duration_ns;
+		sequence->duration_ns += (uint64_t)e.length * 1000000ULL;
+		if (e.type != EventType::Beep) {
+			waited = true;
+			continue;
+		}
+
+		size_t samples = (size_t)sampleRate * std::min(e.length, maxBeepLength) / 1000;
+		std::vector<BeepSegment> &segments = sequence->segments;
+		if (waited || segments.back().sampleCount() + samples > maxSegmentSamples) {
+			segments.push_back({start, std::vector<uint8_t>(sizeof(wav_hdr))});
+			waited = false;
+		}
 
-	std::vector<uint8_t> output;
-	output.resize(sizeof(wav) + pcm.size() * sizeof(pcm[0]));
-	memcpy(output.data(), &wav, sizeof(wav));
-	memcpy(output.data() + sizeof(wav), pcm.data(), pcm.size() * sizeof(pcm[0]));
-	return output;
+		std::vector<uint8_t> &wave = segments.back().wave;
+		size_t offset = wave.size();
+		wave.resize(offset + samples * sizeof(int16_t));
+		int16_t *output = reinterpret_cast<int16_t *>(wave.data() + offset);
+
+		SineOscillator sineOscillator((float)e.frequency, 1.0f);
+		for (size_t j = 0; j < samples; j++)
+			output[j] = static_cast<int16_t>(sineOscillator.process() * maxAmplitude);
+
+		// A cut beep is followed by silence until its end
+		if (e.length > maxBeepLength)
+			waited = true;
+	}
+
+	for (BeepSegment &segment : sequence->segments) {
+		FinishSegment(segment);
+		sequence->bytes += segment.wave.size();
+	}
+
+	return sequence;
 }
 
-std::map<std::pair<float, float>, std::vector<uint8_t>> beepCache;
+static BeepSequencePtr FindSequence(const std::vector<Event> &events)
+{
+	for (auto it = sequenceCache.begin(); it != sequenceCache.end(); ++it) {
+		if ((*it)->events == events) {
+			// Move to front as the most recently used
+			sequenceCache.splice(sequenceCache.begin(), sequenceCache, it);
+			return sequenceCache.front();
+		}
+	}
+	return nullptr;
+}
 
-std::vector<uint8_t> CreateBeep(float duration, float freq, float amp)
+BeepSequencePtr CreateSequence(const std::vector<Event> &events)
 {
-	if (auto search = beepCache.find(std::make_pair(duration, freq));
-	    search != beepCache.end()) {
-		return search->second;
+	{
+		std::lock_guard<std::mutex> lock(sequenceCacheMutex);
+		BeepSequencePtr sequence = FindSequence(events);
+		if (sequence)
+			return sequence;
 	}
 
-	SineOscillator sineOscillator(freq, amp);
-	auto maxAmplitude = pow(2, bitDepth - 1) - 1;
-	std::vector<uint16_t> input;
-	for (int i = 0; i < sampleRate * duration; i++) {
-		auto sample = sineOscillator.process();
-		input.push_back(static_cast<uint16_t>(sample * maxAmplitude));
+	// Rendered without the lock, so other filters looking up their sequences aren't held up
+	BeepSequencePtr rendered = RenderSequence(events);
+
+	std::lock_guard<std::mutex> lock(sequenceCacheMutex);
+	// Another thread may have rendered the same events meanwhile
+	BeepSequencePtr sequence = FindSequence(events);
+	if (sequence)
+		return sequence;
+
+	sequenceCache.push_front(rendered);
+	sequenceCacheBytes += rendered->bytes;
+	// The newest sequence is kept even if it alone is over the limit
+	while (sequenceCacheBytes > maxCachedBytes && sequenceCache.size() > 1) {
+		sequenceCacheBytes -= sequenceCache.back()->bytes;
+		sequenceCache.pop_back();
 	}
-	auto result = PcmToWave(input);
-	beepCache.emplace(std::make_pair(duration, freq), result);
-	return result;
-}
\ No newline at end of file
+
+	return rendered;
+}
@@ -22,14 +22,27 @@ with this program. If not, see <https://www.gnu.org/licenses/>
 #include <cmath>
 #include <cstdint>
 #include <cstring>
-#include <map>
 #include <math.h>
+#include <memory>
 #include <vector>
 
 const int sampleRate = 44100;
 const int bitDepth = 16;
 const int numberOfChannels = 1;
 
+enum class EventType { Beep, Wait };
+
+struct Event {
+	EventType type;
+	int length;
+	int frequency;
+
+	bool operator==(const Event &other) const
+	{
+		return type == other.type && length == other.length && frequency == other.frequency;
+	}
+};
+
 class SineOscillator {
 	float frequency, amplitude, angle = 0.0f, offset = 0.0f;
 
@@ -58,8 +71,33 @@ typedef struct WAVE_HDR {
 	uint32_t Subchunk2Size = 0;                    // Sampled data length
 } wav_hdr;
 
-std::vector<uint8_t> PcmToWave(std::vector<uint16_t> pcm);
+// Consecutive beeps of a sequence rendered into PCM
+struct BeepSegment {
+	// From the start of the sequence
+	uint64_t offset_ns;
+	// WAV header followed by the 16-bit samples
+	std::vector<uint8_t> wave;
+
+	const int16_t *samples() const
+	{
+		return reinterpret_cast<const int16_t *>(wave.data() + sizeof(wav_hdr));
+	}
+	size_t sampleCount() const { return (wave.size() - sizeof(wav_hdr)) / sizeof(int16_t); }
+};
+
+// Event list rendered once into PCM, shared between every filter playing the same events.
+// Only the beeps are rendered, waits are the time between the segments.
+struct BeepSequence {
+	std::vector<Event> events;
+	std::vector<BeepSegment> segments;
+	uint64_t duration_ns;
+	// Memory taken by the rendered segments
+	size_t bytes;
+};
+
+typedef std::shared_ptr<const BeepSequence> BeepSequencePtr;
 
-std::vector<uint8_t> CreateBeep(float duration, float freq, float amp);
+// Returns the rendered sequence from the cache, rendering it on a miss. Thread safe.
+BeepSequencePtr CreateSequence(const std::vector<Event> &events);
 
 #endif
\ No newline at end of file
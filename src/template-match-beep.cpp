@@ -17,7 +17,17 @@ with this program. If not, see <https://www.gnu.org/licenses/>
 */
 
 // Remember to bundle with the opencv binaries!
+#include "BeepScheduler.h"
 #include "CustomBeepSettings.h"
+#include "DebugView.h"
+#include "DetectionTrace.h"
+#include "FrameHandoff.h"
+#include "MatchPipeline.h"
+#include "NccKernel.h"
+#include "PipelineStats.h"
+#include "ScoreHistory.h"
+#include "TemplateMatcher.h"
+#include "ThreadPool.h"
 #include "audio.h"
 #ifdef __cplusplus
 #undef NO
@@ -27,15 +37,19 @@ with this program. If not, see <https://www.gnu.org/licenses/>
 #endif
 
 #include <obs-module.h>
+#include <util/platform.h>
 #include <QFileDialog>
 #include <QStandardPaths>
+#include <algorithm>
 #include <string>
-#include <chrono>
+#include <atomic>
+#include <memory>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
 #include <thread>
 #include <math.h>
 
-#include "vendor/beep/beep.h"
-
 #ifdef __OBJC__
 #import <UIKit/UIKit.h>
 #import <Foundation/Foundation.h>
@@ -55,12 +69,45 @@ OBS_MODULE_USE_DEFAULT_LOCALE(PLUGIN_NAME, "en-US")
 #define MSEC_TO_SEC 0.001
 #endif
 
+// Templates matched by one filter, slots after the first are optional setting groups
+#define MAX_TEMPLATES 8
+#define DEFAULT_THRESHOLD 0.8
+// Statistics are logged this often while matching (os_gettime_ns)
+#define STATS_LOG_INTERVAL (60 * SEC_TO_NSEC)
+// Latest detections kept for the trace
+#define DETECTION_TRACE_SIZE 1024
+// Frames of best scores kept, half a minute at 60 fps
+#define SCORE_HISTORY_SIZE 1800
+
 #define SETTING_AUTO_ROI "auto_roi"
 #define SETTING_COOLDOWN_MS "cooldown_ms"
+#define SETTING_REARM "cooldown_rearm"
+#define SETTING_REPORT_SUPPRESSED "cooldown_report"
+#define SETTING_TEMPLATE "template"
 #define SETTING_PATH "template_path"
+#define SETTING_THRESHOLD "template_threshold"
 #define SETTING_SAVE_FRAME "save_frame"
 #define SETTING_BEEP_SETTINGS "beep_settings"
 #define SETTING_DBUG_VIEW "debug_view"
+#define SETTING_PYRAMID_LEVELS "pyramid_levels"
+#define SETTING_SCALE_MIN "scale_min"
+#define SETTING_SCALE_MAX "scale_max"
+#define SETTING_MATCH_METHOD "match_method"
+#define SETTING_RELEASE_MARGIN "release_margin"
+#define SETTING_CONFIRM_FRAMES "confirm_frames"
+#define SETTING_CONFIRM_WINDOW "confirm_window"
+#define SETTING_TRACKING "tracking"
+#define SETTING_TRACKING_MISSES "tracking_misses"
+#define SETTING_SKIP_UNCHANGED "skip_unchanged"
+#define SETTING_CHANGE_THRESHOLD "change_threshold"
+#define SETTING_ANALYSIS_RATE "analysis_rate"
+#define SETTING_ADAPTIVE_RATE "adaptive_rate"
+#define SETTING_FRAME_BUDGET "frame_budget_ms"
+#define SETTING_STATS "stats"
+#define SETTING_STATS_TEXT "stats_text"
+#define SETTING_STATS_REFRESH "stats_refresh"
+#define SETTING_SAVE_TRACE "save_trace"
+#define SETTING_SAVE_SCORES "save_scores"
 #define SETTING_XYGROUP "xygroup"
 #define SETTING_XYGROUP_X1 "xygroup_x1"
 #define SETTING_XYGROUP_X2 "xygroup_x2"
@@ -69,46 +116,111 @@ OBS_MODULE_USE_DEFAULT_LOCALE(PLUGIN_NAME, "en-US")
 
 #define TEXT_AUTO_ROI obs_module_text("Automatic ROI on next detection")
 #define TEXT_COOLDOWN_MS obs_module_text("Cooldown timer")
+#define TEXT_REARM obs_module_text("Beep again when a template reappears during cooldown")
+#define TEXT_REPORT_SUPPRESSED obs_module_text("Log matches suppressed by the cooldown")
+#define TEXT_TEMPLATE obs_module_text("Template")
 #define TEXT_PATH obs_module_text("Template image path")
+#define TEXT_THRESHOLD obs_module_text("Match threshold")
 #define TEXT_SAVE_FRAME obs_module_text("Save frame")
 #define TEXT_BEEP_SETTINGS obs_module_text("Beep settings")
 #define TEXT_DBUG_VIEW obs_module_text("Debug view")
+#define TEXT_PYRAMID_LEVELS obs_module_text("Search accuracy")
+#define TEXT_PYRAMID_LEVELS_0 obs_module_text("Exact (full resolution)")
+#define TEXT_PYRAMID_LEVELS_1 obs_module_text("High (1/2 scale first)")
+#define TEXT_PYRAMID_LEVELS_2 obs_module_text("Balanced (1/4 scale first)")
+#define TEXT_PYRAMID_LEVELS_3 obs_module_text("Fast (1/8 scale first)")
+#define TEXT_SCALE_MIN obs_module_text("Smallest template scale")
+#define TEXT_SCALE_MAX obs_module_text("Largest template scale")
+#define TEXT_MATCH_METHOD obs_module_text("Match method")
+#define TEXT_MATCH_METHOD_CCOEFF obs_module_text("Correlation coefficient (most robust)")
+#define TEXT_MATCH_METHOD_CCORR obs_module_text("Cross correlation")
+#define TEXT_MATCH_METHOD_SQDIFF_NORMED obs_module_text("Normalized squared difference")
+#define TEXT_RELEASE_MARGIN obs_module_text("Release below threshold minus")
+#define TEXT_CONFIRM_FRAMES obs_module_text("Detect after matching frames")
+#define TEXT_CONFIRM_WINDOW obs_module_text("Out of the last frames")
+#define TEXT_TRACKING obs_module_text("Track templates after detection")
+#define TEXT_TRACKING_MISSES obs_module_text("Lost after missing")
+#define TEXT_SKIP_UNCHANGED obs_module_text("Skip matching while the image doesn't change")
+#define TEXT_CHANGE_THRESHOLD obs_module_text("Change threshold")
+#define TEXT_ANALYSIS_RATE obs_module_text("Max analysis rate (0 = every frame)")
+#define TEXT_ADAPTIVE_RATE obs_module_text("Drop frames while matching falls behind")
+#define TEXT_FRAME_BUDGET obs_module_text("Time budget per frame (0 = none)")
+#define TEXT_STATS obs_module_text("Statistics")
+#define TEXT_STATS_REFRESH obs_module_text("Refresh statistics")
+#define TEXT_SAVE_TRACE obs_module_text("Save detection trace")
+#define TEXT_SAVE_SCORES obs_module_text("Save score history")
 #define TEXT_XYGROUP obs_module_text("Region of interest")
 #define TEXT_XYGROUP_X1 obs_module_text("Top left X")
 #define TEXT_XYGROUP_X2 obs_module_text("Bottom right X")
 #define TEXT_XYGROUP_Y1 obs_module_text("Top left Y")
 #define TEXT_XYGROUP_Y2 obs_module_text("Bottom right Y")
 
+// Matches the frames of every filter, created when the module loads
+static std::unique_ptr<ThreadPool> thread_pool;
+
 struct template_match_beep_data {
 	obs_source_t *context;
 	obs_source_t *source;
 
 	obs_data_t *settings;
 
-	obs_source_frame *current_frame;
-	cv::UMat current_cv_frame;
-
-	std::thread thread;
-	bool thread_active;
-	// Check if we need to destroy the debug window
-	bool debug_view_active;
-
-	// LiveVisionKit, OBS Frame -> OpenCV frame
-	std::unique_ptr<lvk::FrameIngest> frame_ingest;
+	// Latest frame from the video callback to the match job
+	std::unique_ptr<FrameHandoff> frame_handoff;
+	// Rows the match job needs out of the next frames, the video callback copies only these
+	std::atomic<FrameRows> copy_rows;
+	std::atomic<uint32_t> frame_width, frame_height;
+
+	// Frames are matched by jobs on the shared thread pool, one job per filter at a time
+	std::atomic<bool> matching_active;
+	std::mutex job_mutex;
+	std::condition_variable job_idle;
+	bool job_scheduled;
+
+	// Draws the matcher's view at its own rate, created with the filter and only running
+	// while the debug view is enabled
+	std::unique_ptr<DebugView> debug_window;
+	std::vector<DebugMatch> debug_matches;
+
+	// Frame analysis of the match job, carrying its buffers and state to the next job
+	std::unique_ptr<MatchPipeline> pipeline;
+	// Frames are still matched during the cooldown after a detection, only beeping waits
+	// for it to end (os_gettime_ns)
+	uint64_t cooldown_end;
+	// Template slots detected on the previous matched frame
+	bool present[MAX_TEMPLATES];
+	uint64_t suppressed_matches;
+
+	// Stage timings and frame counters, written without locks from every thread
+	PipelineStats stats;
+	uint64_t stats_logged;
+	// Timestamps of the latest detections, from the source frame to the audio
+	DetectionTrace trace{DETECTION_TRACE_SIZE};
+	// Best score of every template slot on the latest frames
+	ScoreHistory score_history{SCORE_HISTORY_SIZE, MAX_TEMPLATES};
+	ScoreHistory::Sample score_samples[MAX_TEMPLATES];
 
 	// Plugin settings
 	uint64_t cooldown_timer;
-	const char *path;
+	bool rearm;
+	bool report_suppressed;
 	bool debug_view;
+	bool skip_unchanged;
+	double change_threshold;
+	double analysis_rate;
+	bool adaptive_rate;
+	uint64_t frame_budget;
 
-	cv::Mat template_image;
+	// Swapped as a whole by update, the matcher keeps the list it loaded until its next frame
+	std::shared_ptr<const TemplateList> templates;
 
 	cv::Rect roi;
 	bool auto_roi;
 	int xygroup_x1, xygroup_y1;
 	int xygroup_x2, xygroup_y2;
 
-	CustomBeepSettings *custom_settings;
+	std::unique_ptr<CustomBeepSettings> custom_settings[MAX_TEMPLATES];
+	// Plays the events off the thread pool
+	std::unique_ptr<BeepScheduler> beep_scheduler;
 
 	signal_handler_t *signal_handler;
 };
@@ -118,6 +230,128 @@ static const char *template_match_beep_filter_name(void *)
 	return obs_module_text("Template Match Timer");
 }
 
+// Setting name of a template slot, the first slot keeps the names from before multiple templates
+static std::string slot_setting(const char *name, size_t slot)
+{
+	if (slot == 0)
+		return name;
+
+	return std::string(name) + "_" + std::to_string(slot);
+}
+
+// Loads a template as grayscale, transparent pixels of images with alpha are left out of the
+// mask. The mask stays empty when every pixel is opaque.
+static bool load_template(const std::string &path, cv::Mat &image, cv::Mat &mask)
+{
+	cv::Mat loaded = cv::imread(path, cv::IMREAD_UNCHANGED);
+	if (loaded.empty())
+		return false;
+
+	if (loaded.depth() == CV_16U)
+		loaded.convertTo(loaded, CV_8U, 1.0 / 256.0);
+	else if (loaded.depth() != CV_8U)
+		return false;
+
+	mask.release();
+	switch (loaded.channels()) {
+	case 1:
+		image = loaded;
+		break;
+	case 3:
+		cv::cvtColor(loaded, image, cv::COLOR_BGR2GRAY);
+		break;
+	case 4:
+		cv::cvtColor(loaded, image, cv::COLOR_BGRA2GRAY);
+		cv::extractChannel(loaded, mask, 3);
+		cv::threshold(mask, mask, 0, 255, cv::THRESH_BINARY);
+		if (cv::countNonZero(mask) == (int)mask.total())
+			mask.release();
+		break;
+	default:
+		return false;
+	}
+
+	return true;
+}
+
+static void update_templates(struct template_match_beep_data *filter, obs_data_t *settings)
+{
+	std::shared_ptr<const TemplateList> old_templates = std::atomic_load(&filter->templates);
+	auto new_templates = std::make_shared<TemplateList>();
+
+	int pyramid_levels = (int)obs_data_get_int(settings, SETTING_PYRAMID_LEVELS);
+	double min_scale = (double)obs_data_get_int(settings, SETTING_SCALE_MIN) / 100.0;
+	double max_scale = (double)obs_data_get_int(settings, SETTING_SCALE_MAX) / 100.0;
+	int method = (int)obs_data_get_int(settings, SETTING_MATCH_METHOD);
+	// Plain squared difference is no longer offered, its scores didn't fit the threshold
+	if (method == cv::TM_SQDIFF)
+		method = cv::TM_SQDIFF_NORMED;
+	double release_margin = obs_data_get_double(settings, SETTING_RELEASE_MARGIN);
+	int confirm_frames = (int)obs_data_get_int(settings, SETTING_CONFIRM_FRAMES);
+	int confirm_window = (int)obs_data_get_int(settings, SETTING_CONFIRM_WINDOW);
+	int tracking_misses = obs_data_get_bool(settings, SETTING_TRACKING)
+				      ? (int)obs_data_get_int(settings, SETTING_TRACKING_MISSES)
+				      : 0;
+
+	for (size_t i = 0; i < MAX_TEMPLATES; i++) {
+		if (filter->custom_settings[i] == nullptr) {
+			std::string array_name = slot_setting(SETTING_EVENT_ARRAY, i);
+			filter->custom_settings[i] =
+				std::make_unique<CustomBeepSettings>(array_name.c_str());
+		}
+
+		filter->custom_settings[i]->CreateOBSSettings(settings);
+
+		std::string group = slot_setting(SETTING_TEMPLATE, i);
+		if (i > 0 && !obs_data_get_bool(settings, group.c_str()))
+			continue;
+
+		std::string path_name = slot_setting(SETTING_PATH, i);
+		std::string threshold_name = slot_setting(SETTING_THRESHOLD, i);
+		std::string path = obs_data_get_string(settings, path_name.c_str());
+		double threshold = obs_data_get_double(settings, threshold_name.c_str());
+		if (path.empty())
+			continue;
+
+		// The matcher of the slot is kept while only its detection settings change, so it
+		// remembers its scale, tracking window and the frames it debounced. Otherwise the
+		// loaded image is reused while the path stays the same.
+		std::shared_ptr<TemplateMatcher> matcher;
+		cv::Mat image;
+		cv::Mat mask;
+		if (old_templates) {
+			for (const auto &old : *old_templates) {
+				if (old->Slot() == i &&
+				    old->SameSearch(path, pyramid_levels, method, min_scale,
+						    max_scale)) {
+					matcher = old;
+					break;
+				}
+				if (old->Path() == path) {
+					image = old->Image();
+					mask = old->Mask();
+				}
+			}
+		}
+		if (matcher) {
+			matcher->SetThreshold(threshold);
+		} else {
+			if (image.empty() && !load_template(path, image, mask)) {
+				blog(LOG_WARNING, "failed to load template image %s", path.c_str());
+				continue;
+			}
+			matcher = std::make_shared<TemplateMatcher>(i, path, image, mask, threshold,
+								    pyramid_levels, method,
+								    min_scale, max_scale);
+		}
+		matcher->SetTracking(tracking_misses);
+		matcher->SetDebounce(threshold - release_margin, confirm_frames, confirm_window);
+		new_templates->push_back(matcher);
+	}
+
+	std::atomic_store(&filter->templates, std::shared_ptr<const TemplateList>(new_templates));
+}
+
 // Filters settings were updated
 static void template_match_beep_filter_update(void *data, obs_data_t *settings)
 {
@@ -125,14 +359,9 @@ static void template_match_beep_filter_update(void *data, obs_data_t *settings)
 
 	uint64_t new_cooldown = (uint64_t)obs_data_get_int(settings, SETTING_COOLDOWN_MS);
 
-	const char *new_path = (const char *)obs_data_get_string(settings, SETTING_PATH);
-
 	bool new_view = (bool)obs_data_get_bool(settings, SETTING_DBUG_VIEW);
 
-	if (filter->custom_settings == nullptr)
-		filter->custom_settings = new CustomBeepSettings();
-
-	filter->custom_settings->CreateOBSSettings(settings);
+	update_templates(filter, settings);
 
 	// ROI group
 	if (obs_data_get_bool(settings, SETTING_XYGROUP)) {
@@ -153,44 +382,80 @@ static void template_match_beep_filter_update(void *data, obs_data_t *settings)
 			       cv::Point(filter->xygroup_x2, filter->xygroup_y2));
 
 	filter->cooldown_timer = new_cooldown;
-	// Update template image on new path
-	if (filter->path != new_path) {
-		filter->path = new_path;
-		filter->template_image = cv::imread(new_path, 0);
-	}
-	if (filter->debug_view != new_view) {
-		filter->debug_view = new_view;
-		if (!new_view && filter->debug_view_active) {
-			cv::destroyWindow(SETTING_DBUG_VIEW);
-			filter->debug_view_active = false;
-		}
-	}
+	filter->rearm = obs_data_get_bool(settings, SETTING_REARM);
+	filter->report_suppressed = obs_data_get_bool(settings, SETTING_REPORT_SUPPRESSED);
+	filter->skip_unchanged = obs_data_get_bool(settings, SETTING_SKIP_UNCHANGED);
+	filter->change_threshold = obs_data_get_double(settings, SETTING_CHANGE_THRESHOLD);
+	filter->analysis_rate = obs_data_get_double(settings, SETTING_ANALYSIS_RATE);
+	filter->adaptive_rate = obs_data_get_bool(settings, SETTING_ADAPTIVE_RATE);
+	filter->frame_budget =
+		(uint64_t)obs_data_get_int(settings, SETTING_FRAME_BUDGET) * SEC_TO_NSEC / 1000;
+	// Each filter has a window of its own
+	filter->debug_view = new_view;
+	filter->debug_window->SetEnabled(new_view, std::string(TEXT_DBUG_VIEW) + ": " +
+							   obs_source_get_name(filter->context));
 }
 
-void thread_loop(void *data);
+void match_frame(struct template_match_beep_data *filter);
 
-void start_thread(void *data)
+void start_matching(void *data)
 {
 	struct template_match_beep_data *filter = (template_match_beep_data *)data;
 
-	if (filter->thread_active || !obs_source_enabled(filter->context))
+	if (!obs_source_enabled(filter->context))
 		return;
 
-	filter->thread_active = true;
-	filter->thread = std::thread(thread_loop, (void *)filter);
+	filter->matching_active = true;
 }
 
-void end_thread(void *data)
+void stop_matching(void *data)
 {
 	struct template_match_beep_data *filter = (template_match_beep_data *)data;
 
-	if (!filter->thread_active)
+	{
+		std::unique_lock<std::mutex> lock(filter->job_mutex);
+		if (!filter->matching_active)
+			return;
+
+		// A job already scheduled sees this and returns without matching
+		filter->matching_active = false;
+		filter->job_idle.wait(lock, [filter] { return !filter->job_scheduled; });
+	}
+
+	filter->frame_handoff->Clear();
+	filter->beep_scheduler->Clear();
+
+	// Templates visible when matching starts again count as appearing
+	std::fill(std::begin(filter->present), std::end(filter->present), false);
+}
+
+static void run_match_job(struct template_match_beep_data *filter)
+{
+	if (filter->matching_active)
+		match_frame(filter);
+
+	std::lock_guard<std::mutex> lock(filter->job_mutex);
+	// Frames published while this job ran didn't schedule another one. It goes behind the
+	// jobs of other filters queued on this worker, so a busy filter can't starve them.
+	if (filter->matching_active && filter->frame_handoff->Pending()) {
+		thread_pool->Submit([filter] { run_match_job(filter); });
 		return;
+	}
+
+	// NOTE: The filter may be destroyed as soon as the lock is released
+	filter->job_scheduled = false;
+	filter->job_idle.notify_all();
+}
 
-	filter->thread_active = false;
+static void schedule_match(struct template_match_beep_data *filter)
+{
+	std::lock_guard<std::mutex> lock(filter->job_mutex);
+	// The scheduled job picks up the newest frame once it runs
+	if (!filter->matching_active || filter->job_scheduled)
+		return;
 
-	filter->thread.join();
-	filter->current_frame = nullptr;
+	filter->job_scheduled = true;
+	thread_pool->Submit([filter] { run_match_job(filter); });
 }
 
 static void template_match_beep_filter_enabled(void *data, calldata_t *calldata)
@@ -198,24 +463,28 @@ static void template_match_beep_filter_enabled(void *data, calldata_t *calldata)
 	bool enabled = calldata_bool(calldata, "enabled");
 
 	if (enabled)
-		start_thread(data);
+		start_matching(data);
 	else
-		end_thread(data);
+		stop_matching(data);
 }
 
 static void *template_match_beep_filter_create(obs_data_t *settings, obs_source_t *context)
 {
-	struct template_match_beep_data *filter =
-		(template_match_beep_data *)bzalloc(sizeof(*filter));
+	// NOTE: Value initialization zeroes the plain members like bzalloc would, but also
+	// constructs the synchronization members properly.
+	struct template_match_beep_data *filter = new template_match_beep_data();
 
 	filter->context = context;
+	filter->frame_handoff = std::make_unique<FrameHandoff>();
+	filter->copy_rows = FrameHandoff::ALL_ROWS;
+	filter->pipeline = std::make_unique<MatchPipeline>(*thread_pool, filter->stats);
+	filter->beep_scheduler = std::make_unique<BeepScheduler>(&filter->stats, &filter->trace);
+	filter->debug_window = std::make_unique<DebugView>();
 	template_match_beep_filter_update(filter, settings);
-	filter->current_frame = nullptr;
 
 	filter->source = nullptr;
 
 	filter->settings = settings;
-	filter->debug_view_active = false;
 
 	filter->signal_handler = obs_source_get_signal_handler(context);
 	signal_handler_connect(filter->signal_handler, "enable", template_match_beep_filter_enabled,
@@ -231,8 +500,8 @@ static void template_match_beep_filter_destroy(void *data)
 	signal_handler_disconnect(filter->signal_handler, "enable",
 				  template_match_beep_filter_enabled, filter);
 
-	end_thread(data);
-	bfree(data);
+	stop_matching(data);
+	delete filter;
 }
 
 bool template_match_beep_save_frame(obs_properties_t *, obs_property_t *, void *data)
@@ -240,7 +509,19 @@ bool template_match_beep_save_frame(obs_properties_t *, obs_property_t *, void *
 	struct template_match_beep_data *filter = (template_match_beep_data *)data;
 
 	cv::UMat umat, umat2;
-	filter->frame_ingest->upload(filter->current_frame, umat);
+	// Copy the frame the matcher last saw, the matcher keeps it alive while we read it
+	filter->frame_handoff->ReadAcquired([&umat](const obs_source_frame *frame, FrameRows rows) {
+		if (frame == nullptr)
+			return;
+		// With a region of interest only its rows were copied, the rest are stale
+		auto frame_ingest = lvk::FrameIngest::Select(frame->format);
+		if (frame_ingest)
+			frame_ingest->upload(frame, umat,
+					     cv::Rect(0, (int)rows.first, (int)frame->width,
+						      (int)rows.count));
+	});
+	if (umat.empty())
+		return true;
 	// Changing color format, this may become issue
 	cv::cvtColor(umat, umat2, cv::COLOR_YUV2BGR, 4);
 	// Save image dialog
@@ -254,15 +535,82 @@ bool template_match_beep_save_frame(obs_properties_t *, obs_property_t *, void *
 	return true;
 }
 
+// Asks where to save the log and writes it as CSV, the log being anything with WriteCsv
+template<class Log> static void save_csv(const Log &log, const std::string &what)
+{
+	QString filename = QFileDialog::getSaveFileName(
+		nullptr, QString::fromStdString("Save " + what),
+		QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation), "*.csv");
+
+	if (!filename.isNull() && !log.WriteCsv(filename.toStdString()))
+		blog(LOG_WARNING, "failed to write %s %s", what.c_str(),
+		     filename.toStdString().c_str());
+}
+
+bool template_match_beep_save_trace(obs_properties_t *, obs_property_t *, void *data)
+{
+	struct template_match_beep_data *filter = (template_match_beep_data *)data;
+	save_csv(filter->trace, "detection trace");
+	return false;
+}
+
+bool template_match_beep_save_scores(obs_properties_t *, obs_property_t *, void *data)
+{
+	struct template_match_beep_data *filter = (template_match_beep_data *)data;
+	save_csv(filter->score_history, "score history");
+	return false;
+}
+
 bool template_match_beep_settings(obs_properties_t *, obs_property_t *, void *data)
+{
+	CustomBeepSettings *custom_settings = (CustomBeepSettings *)data;
+
+	custom_settings->ShowSettingsWindow();
+
+	return true;
+}
+
+static bool template_match_beep_refresh_stats(obs_properties_t *props, obs_property_t *,
+					      void *data)
 {
 	struct template_match_beep_data *filter = (template_match_beep_data *)data;
 
-	filter->custom_settings->ShowSettingsWindow();
+	obs_property_t *text = obs_properties_get(props, SETTING_STATS_TEXT);
+	obs_property_set_description(text, filter->stats.Summary().c_str());
 
 	return true;
 }
 
+static void template_match_beep_filter_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_int(settings, SETTING_SCALE_MIN, 100);
+	obs_data_set_default_int(settings, SETTING_SCALE_MAX, 100);
+	obs_data_set_default_int(settings, SETTING_MATCH_METHOD, cv::TM_CCOEFF_NORMED);
+	obs_data_set_default_int(settings, SETTING_CONFIRM_FRAMES, 1);
+	obs_data_set_default_int(settings, SETTING_CONFIRM_WINDOW, 1);
+	obs_data_set_default_int(settings, SETTING_TRACKING_MISSES, 30);
+	obs_data_set_default_double(settings, SETTING_CHANGE_THRESHOLD, 2.0);
+
+	for (size_t i = 0; i < MAX_TEMPLATES; i++)
+		obs_data_set_default_double(settings, slot_setting(SETTING_THRESHOLD, i).c_str(),
+					    DEFAULT_THRESHOLD);
+}
+
+// Path, threshold and beep settings of one template slot
+static void add_template_properties(obs_properties_t *props,
+				    struct template_match_beep_data *filter, size_t slot)
+{
+	obs_properties_add_path(props, slot_setting(SETTING_PATH, slot).c_str(), TEXT_PATH,
+				OBS_PATH_FILE, "*.png", NULL);
+
+	obs_properties_add_float_slider(props, slot_setting(SETTING_THRESHOLD, slot).c_str(),
+					TEXT_THRESHOLD, 0.0, 1.0, 0.01);
+
+	obs_properties_add_button2(props, slot_setting(SETTING_BEEP_SETTINGS, slot).c_str(),
+				   TEXT_BEEP_SETTINGS, template_match_beep_settings,
+				   filter->custom_settings[slot].get());
+}
+
 static obs_properties_t *template_match_beep_filter_properties(void *data)
 {
 	struct template_match_beep_data *filter = (template_match_beep_data *)data;
@@ -272,18 +620,100 @@ static obs_properties_t *template_match_beep_filter_properties(void *data)
 	obs_property_t *c = obs_properties_add_int(props, SETTING_COOLDOWN_MS, TEXT_COOLDOWN_MS,
 						   100, INT_MAX, 1);
 	obs_property_int_set_suffix(c, " ms");
-
-	// Template Image path
-	obs_properties_add_path(props, SETTING_PATH, TEXT_PATH, OBS_PATH_FILE, "*.png", NULL);
+	obs_properties_add_bool(props, SETTING_REARM, TEXT_REARM);
+	obs_properties_add_bool(props, SETTING_REPORT_SUPPRESSED, TEXT_REPORT_SUPPRESSED);
+
+	// First template is always shown
+	add_template_properties(props, filter, 0);
+
+	// Rest of the templates, matched only while their group is checked
+	for (size_t i = 1; i < MAX_TEMPLATES; i++) {
+		obs_properties_t *group = obs_properties_create();
+		std::string text = std::string(TEXT_TEMPLATE) + " " + std::to_string(i + 1);
+		obs_properties_add_group(props, slot_setting(SETTING_TEMPLATE, i).c_str(),
+					 text.c_str(), OBS_GROUP_CHECKABLE, group);
+		add_template_properties(group, filter, i);
+	}
 
 	obs_properties_add_button(props, SETTING_SAVE_FRAME, TEXT_SAVE_FRAME,
 				  template_match_beep_save_frame);
 
-	obs_properties_add_button(props, SETTING_BEEP_SETTINGS, TEXT_BEEP_SETTINGS,
-				  template_match_beep_settings);
+	// Accuracy versus speed, coarser levels find the candidates faster but may miss
+	// templates that lose their details when downscaled
+	obs_property_t *p = obs_properties_add_list(props, SETTING_PYRAMID_LEVELS,
+						    TEXT_PYRAMID_LEVELS, OBS_COMBO_TYPE_LIST,
+						    OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(p, TEXT_PYRAMID_LEVELS_0, 0);
+	obs_property_list_add_int(p, TEXT_PYRAMID_LEVELS_1, 1);
+	obs_property_list_add_int(p, TEXT_PYRAMID_LEVELS_2, 2);
+	obs_property_list_add_int(p, TEXT_PYRAMID_LEVELS_3, 3);
+
+	// Templates are also searched resized in steps of about 10 % between these, for sources
+	// whose resolution or UI scale changes. Only the scale the template was last found at
+	// and the ones next to it are searched on every frame.
+	obs_property_t *scale_min = obs_properties_add_int_slider(props, SETTING_SCALE_MIN,
+								  TEXT_SCALE_MIN, 50, 100, 1);
+	obs_property_int_set_suffix(scale_min, " %");
+	obs_property_t *scale_max = obs_properties_add_int_slider(props, SETTING_SCALE_MAX,
+								  TEXT_SCALE_MAX, 100, 200, 1);
+	obs_property_int_set_suffix(scale_max, " %");
+
+	// Scores of every method run from 0 to 1 at a perfect match, but the thresholds that work
+	// differ between them. Only the correlation coefficient has the fast FFT and direct paths.
+	obs_property_t *method = obs_properties_add_list(props, SETTING_MATCH_METHOD,
+							 TEXT_MATCH_METHOD, OBS_COMBO_TYPE_LIST,
+							 OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(method, TEXT_MATCH_METHOD_CCOEFF, cv::TM_CCOEFF_NORMED);
+	obs_property_list_add_int(method, TEXT_MATCH_METHOD_CCORR, cv::TM_CCORR_NORMED);
+	obs_property_list_add_int(method, TEXT_MATCH_METHOD_SQDIFF_NORMED, cv::TM_SQDIFF_NORMED);
+
+	// Debouncing, a detected template stays detected until it scores below its threshold
+	// minus the margin, and isn't detected before enough of the last frames scored it.
+	// Sequences fire when a template becomes detected, so the margin keeps a template
+	// scoring around its threshold from firing again and again.
+	obs_properties_add_float_slider(props, SETTING_RELEASE_MARGIN, TEXT_RELEASE_MARGIN, 0.0,
+					0.5, 0.01);
+	obs_properties_add_int(props, SETTING_CONFIRM_FRAMES, TEXT_CONFIRM_FRAMES, 1, 32, 1);
+	obs_properties_add_int(props, SETTING_CONFIRM_WINDOW, TEXT_CONFIRM_WINDOW, 1, 32, 1);
+
+	// Tracking keeps searching near the last detection, for overlays that move around
+	obs_properties_t *tracking = obs_properties_create();
+	obs_properties_add_group(props, SETTING_TRACKING, TEXT_TRACKING, OBS_GROUP_CHECKABLE,
+				 tracking);
+	obs_property_t *m = obs_properties_add_int(tracking, SETTING_TRACKING_MISSES,
+						   TEXT_TRACKING_MISSES, 1, 1000, 1);
+	obs_property_int_set_suffix(m, " frames");
+
+	// Static scenes reuse the previous results, threshold is in gray levels
+	obs_properties_t *unchanged = obs_properties_create();
+	obs_properties_add_group(props, SETTING_SKIP_UNCHANGED, TEXT_SKIP_UNCHANGED,
+				 OBS_GROUP_CHECKABLE, unchanged);
+	obs_properties_add_float_slider(unchanged, SETTING_CHANGE_THRESHOLD, TEXT_CHANGE_THRESHOLD,
+					0.0, 32.0, 0.5);
+
+	// Scheduling, limits how much CPU the matcher may take from OBS
+	obs_property_t *r = obs_properties_add_float(props, SETTING_ANALYSIS_RATE,
+						     TEXT_ANALYSIS_RATE, 0.0, 240.0, 1.0);
+	obs_property_float_set_suffix(r, " Hz");
+	obs_properties_add_bool(props, SETTING_ADAPTIVE_RATE, TEXT_ADAPTIVE_RATE);
+	obs_property_t *b = obs_properties_add_int(props, SETTING_FRAME_BUDGET, TEXT_FRAME_BUDGET,
+						   0, 1000, 1);
+	obs_property_int_set_suffix(b, " ms");
 
 	obs_properties_add_bool(props, SETTING_DBUG_VIEW, TEXT_DBUG_VIEW);
 
+	// Read-only, the text is the summary at the time the properties were opened or refreshed
+	obs_properties_t *stats = obs_properties_create();
+	obs_properties_add_group(props, SETTING_STATS, TEXT_STATS, OBS_GROUP_NORMAL, stats);
+	obs_properties_add_text(stats, SETTING_STATS_TEXT,
+				filter->stats.Summary().c_str(), OBS_TEXT_INFO);
+	obs_properties_add_button2(stats, SETTING_STATS_REFRESH, TEXT_STATS_REFRESH,
+				   template_match_beep_refresh_stats, filter);
+	obs_properties_add_button2(stats, SETTING_SAVE_TRACE, TEXT_SAVE_TRACE,
+				   template_match_beep_save_trace, filter);
+	obs_properties_add_button2(stats, SETTING_SAVE_SCORES, TEXT_SAVE_SCORES,
+				   template_match_beep_save_scores, filter);
+
 	// Region of interest setting group
 	obs_properties_t *xygroup = obs_properties_create();
 	obs_properties_add_group(props, SETTING_XYGROUP, TEXT_XYGROUP, OBS_GROUP_CHECKABLE,
@@ -294,9 +724,9 @@ static obs_properties_t *template_match_beep_filter_properties(void *data)
 	int width = 640;
 	int height = 480;
 	// Add limits from frame if it exist
-	if (filter->current_frame) {
-		width = filter->current_frame->width;
-		height = filter->current_frame->height;
+	if (filter->frame_width > 0 && filter->frame_height > 0) {
+		width = filter->frame_width;
+		height = filter->frame_height;
 	}
 	obs_properties_add_int(xygroup, SETTING_XYGROUP_X1, TEXT_XYGROUP_X1, 0, width, 1);
 	obs_properties_add_int(xygroup, SETTING_XYGROUP_Y1, TEXT_XYGROUP_Y1, 0, height, 1);
@@ -312,122 +742,143 @@ static void template_match_beep_filter_remove(void *, obs_source_t *)
 	blog(LOG_INFO, "filter removed");
 }
 
-// https://blat-blatnik.github.io/computerBear/making-accurate-sleep-function/
-// ^^ also has windows only implementation for better cpu usage with slightly lower accuracy
-void preciseSleep(double seconds)
-{
-	using namespace std;
-	using namespace std::chrono;
-
-	static double estimate = 5e-3;
-	static double mean = 5e-3;
-	static double m2 = 0;
-	static int64_t count = 1;
-
-	while (seconds > estimate) {
-		auto start = high_resolution_clock::now();
-		this_thread::sleep_for(milliseconds(1));
-		auto end = high_resolution_clock::now();
-
-		double observed = (end - start).count() / 1e9;
-		seconds -= observed;
-
-		++count;
-		double delta = observed - mean;
-		mean += delta / count;
-		m2 += delta * (observed - mean);
-		double stddev = sqrt(m2 / (count - 1));
-		estimate = mean + stddev;
-	}
-
-	// spin lock
-	auto start = high_resolution_clock::now();
-	while ((high_resolution_clock::now() - start).count() / 1e9 < seconds)
-		;
-}
-
-// Thread for template matching and beeping
-void thread_loop(void *data)
+// Template matching and beeping for the newest frame, run as a thread pool job
+void match_frame(struct template_match_beep_data *filter)
 {
-	struct template_match_beep_data *filter = (template_match_beep_data *)data;
+	const obs_source_frame *frame = filter->frame_handoff->Acquire();
+	if (frame == nullptr)
+		return;
 
-	uint64_t frame_ts = 0;
+	std::shared_ptr<const TemplateList> templates = std::atomic_load(&filter->templates);
+	MatchPipeline::Settings settings;
+	// The region of interest is searched for by the whole frame until a match places it
+	settings.roi = filter->auto_roi ? cv::Rect() : filter->roi;
+	settings.skip_unchanged = filter->skip_unchanged;
+	settings.change_threshold = filter->change_threshold;
+	settings.score_maps = filter->debug_view;
+	settings.analysis_rate = filter->analysis_rate;
+	settings.adaptive_rate = filter->adaptive_rate;
+	settings.frame_budget = filter->frame_budget;
+	settings.frame_interval = obs_get_frame_interval_ns();
+
+	MatchPipeline &pipeline = *filter->pipeline;
+	bool analyzed = pipeline.Analyze(frame, filter->frame_handoff->AcquiredRows(), templates,
+					 settings);
+	filter->copy_rows = pipeline.CopyRows();
+	if (!analyzed)
+		return;
 
-	while (filter->thread_active) {
-		// Fixes crashes on media source when enabling/disabling the source
-		if (!obs_source_active(filter->source))
-			filter->current_frame = nullptr;
+	const std::vector<MatchResult> &matches = pipeline.Matches();
+	cv::Rect region = pipeline.Region();
+	uint64_t start = pipeline.Started();
+
+	uint64_t now = os_gettime_ns();
+	bool cooldown = now < filter->cooldown_end;
+	if (!cooldown && filter->suppressed_matches > 0) {
+		if (filter->report_suppressed)
+			blog(LOG_INFO, "%llu matches suppressed by the cooldown",
+			     (unsigned long long)filter->suppressed_matches);
+		filter->suppressed_matches = 0;
+	}
 
-		if (filter->current_frame == nullptr ||
-		    frame_ts >= filter->current_frame->timestamp ||
-		    filter->template_image.empty() || !filter->frame_ingest) {
-			// Wait for next frame
-			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	// Debug view takes a snapshot a few times a second, not every frame
+	bool show_debug = filter->debug_view && filter->debug_window->Wanted(now);
+	filter->debug_matches.clear();
+
+	for (ScoreHistory::Sample &sample : filter->score_samples)
+		sample = {0.0f, 0, 0, true};
+
+	bool detected = false;
+	for (size_t i = 0; i < templates->size(); i++) {
+		const TemplateMatcher &matcher = *(*templates)[i];
+		bool &present = filter->present[matcher.Slot()];
+		bool appeared = matches[i].detected && !present;
+		// Templates the frame budget left unfinished weren't actually lost
+		if (!matches[i].unfinished)
+			present = matches[i].detected;
+
+		// Matches during the cooldown are only counted, unless re-arming lets a template
+		// that disappeared and came back beep again. Not while a sequence is still playing
+		// though, another one would only be queued behind it.
+		bool suppressed = cooldown &&
+				  !(filter->rearm && appeared &&
+				    now >= filter->beep_scheduler->PlaybackEnd());
+
+		// Templates the frame budget left unfinished have no reliable score
+		cv::Point location = matches[i].location + region.tl();
+		ScoreHistory::Sample &sample = filter->score_samples[matcher.Slot()];
+		sample.score = (float)matches[i].score;
+		sample.x = location.x;
+		sample.y = location.y;
+		sample.missing = matches[i].unfinished;
+
+		cv::Rect match_rect(matches[i].location, matcher.Size());
+		if (show_debug)
+			filter->debug_matches.push_back(
+				{match_rect, matches[i].score, matches[i].detected,
+				 suppressed, matcher.ScoreMap(), matcher.ScoreMapArea()});
+
+		// Detected template image! A template that stays on screen fires again once the
+		// cooldown is over, unless it's debounced. Then it only fires again after its score
+		// has dropped below the release threshold.
+		if (!(matcher.Debounced() ? appeared : matches[i].detected))
 			continue;
-		}
 
-		frame_ts = filter->current_frame->timestamp;
-		cv::UMat umatroi, umat, umat2, umat3;
-		filter->frame_ingest->upload(filter->current_frame, umat);
-		if (!filter->roi.empty() && !filter->auto_roi &&
-		    (filter->roi.width >= filter->template_image.cols &&
-		     filter->roi.height >= filter->template_image.rows)) {
-			umat(filter->roi).copyTo(umat);
-		}
-		// Changing color format, this may become issue
-		cv::cvtColor(umat, umat2, cv::COLOR_YUV2BGR, 4);
-
-		// Gray
-		cv::cvtColor(umat2, umat3, cv::COLOR_BGR2GRAY);
-		cv::Mat result;
-		int result_cols = umat3.cols - filter->template_image.cols + 1;
-		int result_rows = umat3.rows - filter->template_image.rows + 1;
-		result.create(result_rows, result_cols, CV_32FC1);
-
-		cv::matchTemplate(umat3, filter->template_image, result, cv::TM_CCOEFF_NORMED);
-
-		double minVal, maxVal;
-		cv::Point minLoc, maxLoc, matchLoc;
-		cv::minMaxLoc(result, &minVal, &maxVal, &minLoc, &maxLoc, cv::Mat());
-		matchLoc = maxLoc;
-
-		cv::threshold(result, result, 0.80, 1.0, cv::THRESH_TOZERO);
-		umat3.copyTo(filter->current_cv_frame);
-		// Detected template image!
-		if (maxVal < 0.8)
+		uint64_t trace_id = filter->trace.Add(matcher.Slot(), matches[i].score,
+						      location.x, location.y, suppressed,
+						      frame->timestamp, now);
+		if (suppressed) {
+			filter->suppressed_matches++;
+			filter->stats.MatchSuppressed();
 			continue;
+		}
 
-		filter->xygroup_x1 = matchLoc.x;
-		filter->xygroup_y1 = matchLoc.y;
-		filter->xygroup_x2 = matchLoc.x + filter->template_image.cols;
-		filter->xygroup_y2 = matchLoc.y + filter->template_image.rows;
-		cv::rectangle(umat3, matchLoc, cv::Point(filter->xygroup_x2, filter->xygroup_y2),
-			      cv::Scalar(255), 2, 8, 0);
 		if (filter->auto_roi) {
+			// Matches are relative to the uploaded region
+			match_rect += region.tl();
+			filter->xygroup_x1 = match_rect.x;
+			filter->xygroup_y1 = match_rect.y;
+			filter->xygroup_x2 = match_rect.x + match_rect.width;
+			filter->xygroup_y2 = match_rect.y + match_rect.height;
 			obs_data_set_bool(filter->settings, SETTING_AUTO_ROI, false);
-			obs_data_set_int(filter->settings, SETTING_XYGROUP_X1, matchLoc.x);
-			obs_data_set_int(filter->settings, SETTING_XYGROUP_Y1, matchLoc.y);
+			obs_data_set_int(filter->settings, SETTING_XYGROUP_X1, filter->xygroup_x1);
+			obs_data_set_int(filter->settings, SETTING_XYGROUP_Y1, filter->xygroup_y1);
 			obs_data_set_int(filter->settings, SETTING_XYGROUP_X2, filter->xygroup_x2);
 			obs_data_set_int(filter->settings, SETTING_XYGROUP_Y2, filter->xygroup_y2);
 			filter->auto_roi = false;
 
-			filter->roi = cv::Rect(matchLoc,
-					       cv::Point(matchLoc.x + filter->template_image.cols,
-							 matchLoc.y + filter->template_image.rows));
+			filter->roi = match_rect;
 		}
 
-		umat3.copyTo(filter->current_cv_frame);
+		// Beep and wait events according to settings, played by the scheduler thread.
+		// Sequences of templates detected on the same frame are played one after another.
+		filter->beep_scheduler->Play(filter->custom_settings[matcher.Slot()]->GetSequence(),
+					     os_gettime_ns(), frame->timestamp, trace_id);
+		detected = true;
+	}
 
-		// NOTE: Beep is asynchronous now, so we sleep always
-		// Beep and wait events according to settings
-		for (Event e : filter->custom_settings->GetEvents()) {
-			if (e.type == EventType::Beep) {
-				beep(e.frequency, e.length);
-			}
-			preciseSleep(e.length * MSEC_TO_SEC);
-		}
-		// Cooldown time until next template match
-		preciseSleep(filter->cooldown_timer * MSEC_TO_SEC);
+	filter->score_history.Add(frame->timestamp, filter->score_samples);
+
+	// Suppressed matches are outlined in the debug view too
+	if (show_debug) {
+		cv::Mat gray = pipeline.Gray().getMat(cv::ACCESS_READ);
+		filter->debug_window->Present(gray, filter->debug_matches, os_gettime_ns() - start,
+					      now);
+	}
+
+	// Cooldown starts once the queued sequences have been played, a cooldown shorter than
+	// the sequences would otherwise let them pile up
+	if (detected)
+		filter->cooldown_end = std::max(now, filter->beep_scheduler->PlaybackEnd()) +
+				       filter->cooldown_timer * 1000000;
+
+	uint64_t end = os_gettime_ns();
+	filter->stats.Record(PipelineStats::STAGE_ANALYSIS, end - start);
+	if (end - filter->stats_logged >= STATS_LOG_INTERVAL) {
+		if (filter->stats_logged != 0)
+			blog(LOG_INFO, "[%s] statistics\n%s", obs_source_get_name(filter->context),
+			     filter->stats.Summary().c_str());
+		filter->stats_logged = end;
 	}
 }
 
@@ -440,22 +891,20 @@ static struct obs_source_frame *template_match_beep_filter_video(void *data,
 	if (filter->source == nullptr)
 		filter->source = obs_filter_get_parent(filter->context);
 
-	// Kind of hacky fix for starting the thread since during create the filter isn't active yet
-	if (!filter->thread_active && obs_source_enabled(filter->context) &&
+	// Kind of hacky fix for starting matching since during create the filter isn't active yet
+	if (!filter->matching_active && obs_source_enabled(filter->context) &&
 	    obs_source_active(filter->source))
-		start_thread(data);
-
-	if (filter->frame_ingest && lvk::FrameIngest::test_obs_frame(frame))
-		filter->current_frame = frame;
-
-	if (!filter->frame_ingest || filter->frame_ingest->format() != frame->format)
-		filter->frame_ingest = lvk::FrameIngest::Select(frame->format);
-
-	// Debug view
-	if (!filter->current_cv_frame.empty() && filter->debug_view) {
-		cv::imshow(SETTING_DBUG_VIEW, filter->current_cv_frame);
-		if (!filter->debug_view_active)
-			filter->debug_view_active = true;
+		start_matching(data);
+
+	// OBS recycles the frame after we return, so the match job gets a copy of it
+	if (filter->matching_active && lvk::FrameIngest::test_obs_frame(frame)) {
+		filter->frame_width = frame->width;
+		filter->frame_height = frame->height;
+		filter->stats.FrameSeen();
+		// Replaced frames never reach a match job
+		if (filter->frame_handoff->Publish(frame, filter->copy_rows))
+			filter->stats.FrameDropped();
+		schedule_match(filter);
 	}
 
 	return frame;
@@ -464,16 +913,19 @@ static struct obs_source_frame *template_match_beep_filter_video(void *data,
 // De/activate are for the parent source (i.e. capture card source) so not the filter it self.
 static void template_match_beep_filter_activate(void *data)
 {
-	start_thread(data);
+	start_matching(data);
 }
 
 static void template_match_beep_filter_deactivate(void *data)
 {
-	end_thread(data);
+	stop_matching(data);
 }
 
 bool obs_module_load(void)
 {
+	// One worker per core, filters only take a worker while they have a frame to match
+	thread_pool = std::make_unique<ThreadPool>(std::thread::hardware_concurrency());
+
 	struct obs_source_info template_match_beep_filter = {};
 	template_match_beep_filter.id = "template_match_beep_filter";
 	template_match_beep_filter.type = OBS_SOURCE_TYPE_FILTER,
@@ -483,17 +935,22 @@ bool obs_module_load(void)
 	template_match_beep_filter.destroy = template_match_beep_filter_destroy;
 	template_match_beep_filter.update = template_match_beep_filter_update,
 	template_match_beep_filter.get_properties = template_match_beep_filter_properties;
+	template_match_beep_filter.get_defaults = template_match_beep_filter_defaults;
 	template_match_beep_filter.filter_video = template_match_beep_filter_video;
 	template_match_beep_filter.filter_remove = template_match_beep_filter_remove;
 	template_match_beep_filter.activate = template_match_beep_filter_activate;
 	template_match_beep_filter.deactivate = template_match_beep_filter_deactivate;
 
 	obs_register_source(&template_match_beep_filter);
+
+	// Small templates fall back to OpenCV if the kernels don't agree with it on this machine
+	NccKernel::SelfTest();
 	blog(LOG_INFO, "plugin loaded successfully (version %s)", PLUGIN_VERSION);
 	return true;
 }
 
 void obs_module_unload()
 {
+	thread_pool.reset();
 	blog(LOG_INFO, "plugin unloaded");
 }
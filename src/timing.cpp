@@ -0,0 +1,127 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#include "timing.h"
+
+#include <util/platform.h>
+
+#include <algorithm>
+#include <cerrno>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#if !defined(__APPLE__)
+#include <sys/prctl.h>
+#endif
+#endif
+
+#ifndef SEC_TO_NSEC
+#define SEC_TO_NSEC 1000000000ULL
+#endif
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+// Guess of the wake up latency before there are any samples
+#define INITIAL_LATENCY 50000.0
+// Never wakes up earlier than this before the deadline
+#define MAX_LATENCY 1000000.0
+// Each sample moves the estimate at most this much, so the occasional very late wake up
+// (preemption, a loaded system) doesn't make every following wake up early. The estimate
+// settles near the median lateness.
+#define LATENCY_STEP 2000.0
+
+PreciseTimer::PreciseTimer() : m_Latency(INITIAL_LATENCY)
+{
+#ifdef _WIN32
+	// High resolution timers need Windows 10 1803, older versions get the regular one
+	m_Timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+					 TIMER_ALL_ACCESS);
+	if (m_Timer == NULL)
+		m_Timer = CreateWaitableTimerW(NULL, TRUE, NULL);
+#endif
+}
+
+PreciseTimer::~PreciseTimer()
+{
+#ifdef _WIN32
+	if (m_Timer != NULL)
+		CloseHandle(m_Timer);
+#endif
+}
+
+uint64_t PreciseTimer::Latency() const
+{
+	return (uint64_t)m_Latency;
+}
+
+uint64_t PreciseTimer::SleepUntil(uint64_t deadline)
+{
+	uint64_t now = os_gettime_ns();
+	while (now + Latency() < deadline) {
+		uint64_t target = deadline - Latency();
+		sleep(now, target);
+		now = os_gettime_ns();
+
+		double error = (double)now - (double)target - m_Latency;
+		m_Latency += std::clamp(error, -LATENCY_STEP, LATENCY_STEP);
+		m_Latency = std::clamp(m_Latency, 0.0, MAX_LATENCY);
+	}
+	return now;
+}
+
+void PreciseTimer::sleep(uint64_t now, uint64_t target)
+{
+#if defined(_WIN32)
+	if (m_Timer == NULL) {
+		Sleep((DWORD)((target - now) / 1000000));
+		return;
+	}
+
+	// Negative due time is relative, in 100 ns units
+	LARGE_INTEGER due;
+	due.QuadPart = -(LONGLONG)((target - now) / 100);
+	if (SetWaitableTimer(m_Timer, &due, 0, NULL, NULL, FALSE))
+		WaitForSingleObject(m_Timer, INFINITE);
+#elif defined(__APPLE__)
+	uint64_t duration = target - now;
+	struct timespec ts;
+	ts.tv_sec = (time_t)(duration / SEC_TO_NSEC);
+	ts.tv_nsec = (long)(duration % SEC_TO_NSEC);
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+		;
+#else
+	// Default timer slack delays wake ups by 50 us, ask for the minimum once per thread
+	static thread_local bool slack_set = false;
+	if (!slack_set) {
+		prctl(PR_SET_TIMERSLACK, 1UL);
+		slack_set = true;
+	}
+
+	// os_gettime_ns is CLOCK_MONOTONIC, so the deadline can be passed as is
+	UNUSED_PARAMETER(now);
+	struct timespec ts;
+	ts.tv_sec = (time_t)(target / SEC_TO_NSEC);
+	ts.tv_nsec = (long)(target % SEC_TO_NSEC);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+#endif
+}
@@ -0,0 +1,56 @@
+/*
+OBS Template Match Beep
+Copyright (C) 2022 - 2023 Janne Pitkänen <acebanzkux@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program. If not, see <https://www.gnu.org/licenses/>
+*/
+
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <cstdint>
+
+// Frame timestamps further in the past aren't on the os_gettime_ns clock
+#define MAX_FRAME_LATENCY 10000000000ULL
+
+// Sleeps until absolute os_gettime_ns deadlines without spinning. The OS wakes a sleeping
+// thread up a little late, so the timer learns how late and asks to be woken up that much
+// earlier. If it still wakes up well before the deadline, it goes back to sleep. The
+// calibration is per instance, so keep one timer per thread.
+class PreciseTimer {
+public:
+	PreciseTimer();
+	~PreciseTimer();
+
+	PreciseTimer(const PreciseTimer &) = delete;
+	PreciseTimer &operator=(const PreciseTimer &) = delete;
+
+	// Returns the time it woke up at
+	uint64_t SleepUntil(uint64_t deadline);
+
+	// How late the OS usually wakes the thread up, in nanoseconds. Sleeps end this much
+	// before the deadline.
+	uint64_t Latency() const;
+
+private:
+	void sleep(uint64_t now, uint64_t target);
+
+	double m_Latency;
+
+#ifdef _WIN32
+	void *m_Timer;
+#endif
+};
+
+#endif // !TIMING_H